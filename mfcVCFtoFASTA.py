@@ -257,12 +257,28 @@ def callSimilarityPhaser(mother, father, child, n_paths):
 
 
 
-def phasedStringToVCF(child):
+def phasedStringToVCF(child, min_margin):
 	var_map1 = child[5]
 	var_map2 = child[6]
 	hetero_vars_applied = child[7]
 	stringfile = open("phase_string.txt", "r")
 	phaseString = list(stringfile.read().strip())
+	# n_paths 0 also writes how much the score drops when each position is
+	# phased the other way. Positions below min_margin are left as '?'.
+	# The other n_paths remove the file, and are not thresholded.
+	if min_margin > 0:
+		try:
+			marginfile = open("phase_margins.txt", "r")
+		except IOError:
+			print "WARNING: no phase_margins.txt (only n_paths 0 writes it), min_margin is ignored."
+			min_margin = 0
+	if min_margin > 0:
+		margins = [int(line) for line in marginfile]
+		marginfile.close()
+		assert(len(margins) == len(phaseString))
+		for pos in range(len(phaseString)):
+			if margins[pos] < min_margin:
+				phaseString[pos] = '?'
 	counts_dict = defaultdict(int)
 	for pos in range(len(phaseString)):
 		if (phaseString[pos] != '?'):
@@ -360,7 +376,12 @@ if (len(sys.argv) == 2):
 else:
 	n_paths = sys.argv[2]
 	print "Using " +str(n_paths) + " paths."
+min_margin = 0
+if (len(sys.argv) > 3):
+	# Only n_paths 0 writes phase_margins.txt.
+	min_margin = int(sys.argv[3])
+	print "Phasing only positions with margin >= " + str(min_margin)
 callSimilarityPhaser(mother, father, child, n_paths)
-phasedStringToVCF(child)
+phasedStringToVCF(child, min_margin)
 
 
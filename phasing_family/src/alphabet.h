@@ -0,0 +1,85 @@
+/* Copyright (C) 2013, Daniel Valenzuela, all rights reserved.
+ * dvalenzu@cs.helsinki.fi
+ */
+
+#ifndef SRC_ALPHABET_H_
+#define SRC_ALPHABET_H_
+
+#include <cstdlib>
+#include "./basic.h"
+
+// Encoded nucleotide alphabet used by Phaser.
+// Sequences are encoded once, when the Phaser is built, so the kernels
+// score pairs of symbols with a table lookup instead of comparing chars.
+typedef unsigned char code_t;
+
+const code_t CODE_A = 0;
+const code_t CODE_C = 1;
+const code_t CODE_G = 2;
+const code_t CODE_T = 3;
+const code_t CODE_N = 4;
+const code_t CODE_GAP = 5;
+const code_t CODE_OTHER = 6;     // any other symbol, see PAIR_OTHERS.
+const code_t CODE_BOUNDARY = 7;  // position 0 of a sub-cube, never scored.
+const size_t ALPHABET_SIZE = 8;
+
+inline code_t Encode(char c) {
+  switch (c) {
+    case 'A':
+      return CODE_A;
+    case 'C':
+      return CODE_C;
+    case 'G':
+      return CODE_G;
+    case 'T':
+      return CODE_T;
+    case 'N':
+      return CODE_N;
+    case '-':
+      return CODE_GAP;
+    default:
+      return CODE_OTHER;
+  }
+}
+
+// Returns a new[] array with the codes of seq.
+inline code_t * EncodeSequence(const char * seq, size_t len) {
+  code_t * ans = new code_t[len];
+  for (size_t i = 0; i < len; i++) {
+    ans[i] = Encode(seq[i]);
+  }
+  return ans;
+}
+
+// Kind of score of a pair of symbols.
+enum pair_t {
+  PAIR_GAPS,      // two gaps.
+  PAIR_MATCH,
+  PAIR_GAP,       // a symbol and a gap.
+  PAIR_MISMATCH,  // two different symbols.
+  PAIR_NONE,      // the boundary, scores 0.
+  PAIR_OTHERS     // two CODE_OTHER, the original symbols decide.
+};
+const size_t N_PAIR_KINDS = 6;
+
+constexpr pair_t PairKind(code_t a, code_t b) {
+  return (a == CODE_BOUNDARY || b == CODE_BOUNDARY) ? PAIR_NONE :
+      (a == CODE_GAP && b == CODE_GAP) ? PAIR_GAPS :
+      (a == CODE_GAP || b == CODE_GAP) ? PAIR_GAP :
+      (a == CODE_OTHER && b == CODE_OTHER) ? PAIR_OTHERS :
+      (a == b) ? PAIR_MATCH : PAIR_MISMATCH;
+}
+
+#define PAIR_KIND_ROW(a) \
+  PairKind(a, 0), PairKind(a, 1), PairKind(a, 2), PairKind(a, 3), \
+  PairKind(a, 4), PairKind(a, 5), PairKind(a, 6), PairKind(a, 7)
+
+// PAIR_KINDS[(a << 3) | b] == PairKind(a, b).
+constexpr pair_t PAIR_KINDS[ALPHABET_SIZE * ALPHABET_SIZE] = {
+  PAIR_KIND_ROW(0), PAIR_KIND_ROW(1), PAIR_KIND_ROW(2), PAIR_KIND_ROW(3),
+  PAIR_KIND_ROW(4), PAIR_KIND_ROW(5), PAIR_KIND_ROW(6), PAIR_KIND_ROW(7)
+};
+
+#undef PAIR_KIND_ROW
+
+#endif  // SRC_ALPHABET_H_
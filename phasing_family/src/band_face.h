@@ -0,0 +1,96 @@
+/* Copyright (C) 2013, Daniel Valenzuela, all rights reserved.
+ * dvalenzu@cs.helsinki.fi
+ */
+
+#ifndef SRC_BAND_FACE_H_
+#define SRC_BAND_FACE_H_
+
+#include <climits>
+#include <algorithm>
+#include "./phaser.h"
+
+// Score of the cells out of the box. Low enough to never win, high enough
+// to never overflow (the sweeps check ScoreBound).
+const score_t BAND_OUTSIDE = INT_MIN / 4;
+
+// The box [i_lo, i_hi] x [j_lo, j_hi] of cells of one k-plane kept by the
+// banded sweeps.
+class BandFace {
+ public:
+  explicit BandFace(size_t max_cells) {
+    capacity = max_cells;
+    scores = new score_t[8 * capacity];
+    checks = new check_t[8 * capacity];
+    for (size_t m = 0; m < 8; m++) {
+      outside_scores[m] = BAND_OUTSIDE;
+      outside_checks[m] = 0;
+    }
+    i_lo = i_hi = j_lo = j_hi = 0;
+  }
+
+  ~BandFace() {
+    delete[] scores;
+    delete[] checks;
+  }
+
+  // The previous contents are lost if the box does not fit.
+  inline void SetBox(size_t _i_lo, size_t _i_hi, size_t _j_lo, size_t _j_hi) {
+    i_lo = _i_lo;
+    i_hi = _i_hi;
+    j_lo = _j_lo;
+    j_hi = _j_hi;
+    if (Cells() > capacity) {
+      capacity = 2 * Cells();
+      delete[] scores;
+      delete[] checks;
+      scores = new score_t[8 * capacity];
+      checks = new check_t[8 * capacity];
+    }
+  }
+
+  inline size_t Cells() {
+    return (i_hi - i_lo + 1) * (j_hi - j_lo + 1);
+  }
+
+  inline bool Inside(size_t i, size_t j) {
+    return i >= i_lo && i <= i_hi && j >= j_lo && j <= j_hi;
+  }
+
+  // Index of the cell (i, j) in the box.
+  inline size_t Offset(size_t i, size_t j) {
+    return (j - j_lo) * (i_hi - i_lo + 1) + (i - i_lo);
+  }
+
+  // Cells out of the band share a read-only block.
+  inline score_t * Scores(size_t i, size_t j) {
+    return Inside(i, j) ? scores + 8 * Offset(i, j) : outside_scores;
+  }
+
+  inline check_t * Checks(size_t i, size_t j) {
+    return Inside(i, j) ? checks + 8 * Offset(i, j) : outside_checks;
+  }
+
+  inline void Swap(BandFace * other) {
+    std::swap(capacity, other->capacity);
+    std::swap(scores, other->scores);
+    std::swap(checks, other->checks);
+    std::swap(i_lo, other->i_lo);
+    std::swap(i_hi, other->i_hi);
+    std::swap(j_lo, other->j_lo);
+    std::swap(j_hi, other->j_hi);
+  }
+
+  size_t i_lo, i_hi, j_lo, j_hi;
+
+ private:
+  size_t capacity;
+  score_t * scores;
+  check_t * checks;
+  score_t outside_scores[8];
+  check_t outside_checks[8];
+
+  BandFace(const BandFace &);
+  BandFace & operator=(const BandFace &);
+};
+
+#endif  // SRC_BAND_FACE_H_
@@ -14,4 +14,13 @@ typedef unsigned int uint;
 typedef unsigned char uchar;
 typedef int score_t;
 
+// Scores are always computed as score_t, but the DP faces may store them
+// in a narrower SCORE type. Narrow flags the values that do not fit.
+template<typename SCORE>
+inline SCORE Narrow(score_t val, bool * saturated) {
+  SCORE ans = static_cast<SCORE>(val);
+  *saturated |= (ans != val);
+  return ans;
+}
+
 #endif  // SRC_BASIC_H_
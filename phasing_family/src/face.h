@@ -0,0 +1,157 @@
+/* Copyright (C) 2013, Daniel Valenzuela, all rights reserved.
+ * dvalenzu@cs.helsinki.fi
+ */
+
+#ifndef SRC_FACE_H_
+#define SRC_FACE_H_
+
+#include <cstdlib>
+#include <cassert>
+#include <algorithm>
+#include "./basic.h"
+
+// One k-plane ("face") of the DP cube.
+// The values of the 8 inheritance states of a cell (i,j) are stored
+// contiguously, so a cell update reads and writes whole blocks instead
+// of touching 8 separate arrays.
+template<typename TYPE>
+class Face {
+ public:
+  explicit Face(size_t _n_cells) {
+    n_cells = _n_cells;
+    data = new TYPE[8 * n_cells];
+    owner = true;
+  }
+
+  // Over the 8 * _n_cells entries of buffer, which the caller keeps.
+  Face(size_t _n_cells, TYPE * buffer) {
+    n_cells = _n_cells;
+    data = buffer;
+    owner = false;
+  }
+
+  ~Face() {
+    if (owner) {
+      delete[] data;
+    }
+  }
+
+  // The 8 states of the cell ij, indexed by Phaser::m_index.
+  inline TYPE * Cell(size_t ij) {
+    assert(ij < n_cells);
+    return data + 8 * ij;
+  }
+
+  inline void Swap(Face<TYPE> * other) {
+    std::swap(data, other->data);
+    std::swap(n_cells, other->n_cells);
+    std::swap(owner, other->owner);
+  }
+
+ private:
+  TYPE * data;
+  size_t n_cells;
+  bool owner;
+
+  Face(const Face<TYPE> &);
+  Face<TYPE> & operator=(const Face<TYPE> &);
+};
+
+// Blocks of the 8 states of a cell (i,j,k) and of its neighbours, as read
+// and written by the update kernels. Neighbours outside the sub-cube are NULL.
+template<typename TYPE>
+struct Neighbourhood {
+  TYPE * curr;       // (i,   j,   k)
+  TYPE * back;       // (i,   j,   k-1)
+  TYPE * left;       // (i-1, j,   k)
+  TYPE * back_left;  // (i-1, j,   k-1)
+  TYPE * down;       // (i,   j-1, k)
+  TYPE * back_down;  // (i,   j-1, k-1)
+  TYPE * back_diag;  // (i-1, j-1, k-1)
+};
+
+// The k-plane of the row sweep, updated in place. The cell (i, j, k) reads
+// the plane k-1 at (i, j), (i-1, j), (i, j-1) and (i-1, j-1), so before it
+// is overwritten its old value is saved in a row buffer: the plane k-1 is
+// only kept for the rows j-1 and j.
+template<typename TYPE>
+class RollingFace {
+ public:
+  RollingFace(size_t _I_len, size_t n_rows)
+      : I_len(_I_len), plane((_I_len + 1) * n_rows), owner(true) {
+    row = new TYPE[8 * (I_len + 1)];
+    down_row = new TYPE[8 * (I_len + 1)];
+  }
+
+  // Over the BufferSize(_I_len, n_rows) entries of buffer, which the caller
+  // keeps: nothing is allocated.
+  RollingFace(size_t _I_len, size_t n_rows, TYPE * buffer)
+      : I_len(_I_len), plane((_I_len + 1) * n_rows, buffer), owner(false) {
+    row = buffer + 8 * (I_len + 1) * n_rows;
+    down_row = row + 8 * (I_len + 1);
+  }
+
+  ~RollingFace() {
+    if (owner) {
+      delete[] row;
+      delete[] down_row;
+    }
+  }
+
+  static inline size_t BufferSize(size_t _I_len, size_t n_rows) {
+    return 8 * (_I_len + 1) * (n_rows + 2);
+  }
+
+  inline TYPE * Cell(size_t i, size_t j) {
+    return plane.Cell(j * (I_len + 1) + i);
+  }
+
+  // Saves the cell (i, j) of the plane k-1, and points ans to the cell
+  // (i, j, k) and its neighbours.
+  inline void Roll(size_t i, size_t j, Neighbourhood<TYPE> * ans) {
+    TYPE * cell = Cell(i, j);
+    std::copy(cell, cell + 8, row + 8*i);
+    ans->curr = cell;
+    ans->back = row + 8*i;
+    ans->left = (i > 0) ? Cell(i-1, j) : NULL;
+    ans->back_left = (i > 0) ? row + 8*(i-1) : NULL;
+    ans->down = (j > 0) ? Cell(i, j-1) : NULL;
+    ans->back_down = (j > 0) ? down_row + 8*i : NULL;
+    ans->back_diag = (i > 0 && j > 0) ? down_row + 8*(i-1) : NULL;
+  }
+
+  // Roll for i > 0 and j > 0.
+  inline void RollInner(size_t i, size_t j, Neighbourhood<TYPE> * ans) {
+    TYPE * cell = Cell(i, j);
+    std::copy(cell, cell + 8, row + 8*i);
+    ans->curr = cell;
+    ans->back = row + 8*i;
+    ans->left = Cell(i-1, j);
+    ans->back_left = row + 8*(i-1);
+    ans->down = Cell(i, j-1);
+    ans->back_down = down_row + 8*i;
+    ans->back_diag = down_row + 8*(i-1);
+  }
+
+  // After the last cell of each row.
+  inline void EndRow() {
+    std::swap(row, down_row);
+  }
+
+  inline Face<TYPE> * Plane() {
+    return &plane;
+  }
+
+ private:
+  size_t I_len;
+  Face<TYPE> plane;
+  // Rows j and j-1 of the plane k-1.
+  TYPE * row;
+  TYPE * down_row;
+  bool owner;
+
+  RollingFace(const RollingFace<TYPE> &);
+  RollingFace<TYPE> & operator=(const RollingFace<TYPE> &);
+};
+
+#endif  // SRC_FACE_H_
@@ -3,7 +3,9 @@
  */
 
 
+#include <algorithm>
 #include <iomanip>
+#include <vector>
 #include "./phaser.h"
 #include "./debug.h"
 #include "./utils.h"
@@ -11,12 +13,46 @@
 score_t SCORE_GAP = -1;
 score_t SCORE_MISMATCH = -1;
 score_t SCORE_MATCH = 1;
+// Megabytes that n_paths 1 may spend on TRACEBACK_FULL, see
+// SetMemoryBudget; the sub-cubes that do not fit are split by the
+// checkpoint recursion. n_paths 2 and 4 always recurse: their '?' come
+// from the tie-breaks of the recursion on the swapped inputs, and the
+// single sweep would break the ties of every run the same way.
+size_t MEMORY_BUDGET_MB = 64;
 
 bool verbose = false;
 void printUssage();
 void printUssage() {
   fprintf(stderr, "Ussage:\n");
-  fprintf(stderr, "./mfc_similarity_phaser fatherA.fa fatherB.fa motherA.fa motherB.fa childA.fa childB.fa n_paths\n");  // NOLINT
+  fprintf(stderr, "./mfc_similarity_phaser fatherA.fa fatherB.fa motherA.fa motherB.fa childA.fa childB.fa n_paths [memory_mb]\n");  // NOLINT
+  fprintf(stderr, "n_paths 0 phases in one pass, with '?' where the co-optimal alignments disagree.\n");  // NOLINT
+  fprintf(stderr, "It also writes phase_margins.txt: per symbol, the score lost by phasing it the other way.\n");  // NOLINT
+  fprintf(stderr, "memory_mb (default 64) bounds the single-sweep traceback of n_paths 1; 0 always recurses.\n");  // NOLINT
+}
+
+// One margin per line, for each column of the child as given; the columns
+// dropped by Utils::Compact were not phased, and get 0 as the '?'.
+void SaveMargins(score_t * margins,
+                 const std::vector<size_t> &columns,
+                 size_t original_len,
+                 const char * file_name);
+void SaveMargins(score_t * margins,
+                 const std::vector<size_t> &columns,
+                 size_t original_len,
+                 const char * file_name) {
+  FILE * file = fopen(file_name, "w");
+  if (file == NULL) {
+    Debug::AbortPrint("SaveMargins: could not open file for: %s \n", file_name);
+  }
+  size_t next = 0;
+  for (size_t p = 0; p < original_len; p++) {
+    score_t margin = 0;
+    if (next < columns.size() && columns[next] == p) {
+      margin = margins[next++];
+    }
+    fprintf(file, "%i\n", margin);
+  }
+  fclose(file);
 }
 
 void negate(char * phase_str, size_t len);
@@ -41,7 +77,8 @@ char * MultiPassPhaser(char * motherA,
                        char * childB,
                        size_t child_len,
                        int n_paths,
-                       score_t * score_ans);
+                       score_t * score_ans,
+                       score_t ** margins_ans);
 
 char * MultiPassPhaser(char * motherA,
                        char * motherB,
@@ -53,15 +90,33 @@ char * MultiPassPhaser(char * motherA,
                        char * childB,
                        size_t child_len,
                        int n_paths,
-                       score_t * score_ans) {
+                       score_t * score_ans,
+                       score_t ** margins_ans) {
+  // The phase strings and margins are copied out of each Phaser, which is
+  // deleted right after.
   char * phase_string_1;
   char * phase_string_2;
-  char * phase_string_3;
-  char * phase_string_4;
+  char * phase_string_3 = NULL;
+  char * phase_string_4 = NULL;
   score_t score_1;
   score_t score_2;
   score_t score_3;
   score_t score_4;
+  *margins_ans = NULL;
+  if (n_paths == 0) {
+    Phaser * phaser =  new Phaser(motherA, motherB, mother_len,
+                                  fatherA, fatherB, father_len,
+                                  childA, childB, child_len);
+    phaser->SetScoreGap(SCORE_GAP);
+    phaser->SetScoreMismatch(SCORE_MISMATCH);
+    phaser->SetScoreMatch(SCORE_MATCH);
+    *score_ans = phaser->similarity_and_consensus();
+    *margins_ans = new score_t[child_len];
+    std::copy(phaser->GetPhaseMargins(), phaser->GetPhaseMargins() + child_len, *margins_ans);
+    char * phase_string = Utils::CopySeq(phaser->GetPhaseString(), child_len);
+    delete phaser;
+    return phase_string;
+  }
   {
     Phaser * phaser =  new Phaser(motherA, motherB, mother_len,
                                   fatherA, fatherB, father_len,
@@ -69,10 +124,16 @@ char * MultiPassPhaser(char * motherA,
     phaser->SetScoreGap(SCORE_GAP);
     phaser->SetScoreMismatch(SCORE_MISMATCH);
     phaser->SetScoreMatch(SCORE_MATCH);
+    if (n_paths == 1) {
+      phaser->SetMemoryBudget(MEMORY_BUDGET_MB << 20);
+    }
     score_1 = phaser->similarity_and_phase();
-    phase_string_1 = phaser->GetPhaseString();
-    if (n_paths == 1) 
+    phase_string_1 = Utils::CopySeq(phaser->GetPhaseString(), child_len);
+    delete phaser;
+    if (n_paths == 1) {
+      *score_ans = score_1;
       return phase_string_1;
+    }
   }
 
   {
@@ -84,7 +145,8 @@ char * MultiPassPhaser(char * motherA,
     phaser->SetScoreMismatch(SCORE_MISMATCH);
     phaser->SetScoreMatch(SCORE_MATCH);
     score_2 = phaser->similarity_and_phase();
-    phase_string_2 = phaser->GetPhaseString();
+    phase_string_2 = Utils::CopySeq(phaser->GetPhaseString(), child_len);
+    delete phaser;
     negate(phase_string_2, child_len);
   }
   if (score_1 != score_2) {
@@ -100,7 +162,8 @@ char * MultiPassPhaser(char * motherA,
       phaser->SetScoreMismatch(SCORE_MISMATCH);
       phaser->SetScoreMatch(SCORE_MATCH);
       score_3 = phaser->similarity_and_phase();
-      phase_string_3 = phaser->GetPhaseString();
+      phase_string_3 = Utils::CopySeq(phaser->GetPhaseString(), child_len);
+      delete phaser;
       negate(phase_string_3, child_len);
     }
     if (score_1 != score_3) {
@@ -116,7 +179,8 @@ char * MultiPassPhaser(char * motherA,
       phaser->SetScoreMismatch(SCORE_MISMATCH);
       phaser->SetScoreMatch(SCORE_MATCH);
       score_4 = phaser->similarity_and_phase();
-      phase_string_4 = phaser->GetPhaseString();
+      phase_string_4 = Utils::CopySeq(phaser->GetPhaseString(), child_len);
+      delete phaser;
     }
     if (score_1 != score_4) {
       fprintf(stderr,"WARNING: Different scores after changing the order of params, this should not occur\n");
@@ -151,16 +215,24 @@ char * MultiPassPhaser(char * motherA,
       consensus[i] = '?';
     }
   }
+  delete[] sum;
+  delete[] phase_string_1;
+  delete[] phase_string_2;
+  delete[] phase_string_3;
+  delete[] phase_string_4;
   *score_ans = score_1;
   return consensus;
 }
 
 
 int main(int argc, char ** argv) {
-  if (argc != 8) {
+  if (argc != 8 && argc != 9) {
     printUssage();
     return EXIT_FAILURE;
   }
+  if (argc == 9) {
+    MEMORY_BUDGET_MB = (size_t)atol(argv[8]);
+  }
   char * motherA;
   char * motherB;
   size_t mother_len;
@@ -198,24 +270,46 @@ int main(int argc, char ** argv) {
   if (child_len != seq_len)
     Debug::AbortPrint("childA and childB have different length. They must be an alignment.\n");
 
-  if (!(argv[7][0] == '1' || argv[7][0] == '2' || argv[7][0] == '4')) {
-    std::cout << " n_paths must be 1, 2 or 4" << std::endl;
+  if (!(argv[7][0] == '0' || argv[7][0] == '1' || argv[7][0] == '2' || argv[7][0] == '4')) {
+    std::cout << " n_paths must be 0, 1, 2 or 4" << std::endl;
     return 33;
   }
   
   int n_paths = atoi(argv[7]);
   std::cout << n_paths << " paths will be used" << std::endl;
 
+  // The FASTAs are padded with gaps wherever another member has an
+  // insertion. Columns where both haplotypes of a member have a gap are
+  // dropped, and the phase of the child is written back to its columns.
+  size_t original_child_len = child_len;
+  std::vector<size_t> mother_columns;
+  std::vector<size_t> father_columns;
+  std::vector<size_t> child_columns;
+  Utils::Compact(&motherA, &motherB, &mother_len, &mother_columns);
+  Utils::Compact(&fatherA, &fatherB, &father_len, &father_columns);
+  Utils::Compact(&childA, &childB, &child_len, &child_columns);
+
   Utils::StartClock();
   score_t score;
-  char * consensus = MultiPassPhaser(motherA, motherB, mother_len,
-                                     fatherA, fatherB, father_len,
-                                     childA, childB, child_len, 
-                                     n_paths, &score);
+  score_t * margins;
+  char * compact_consensus = MultiPassPhaser(motherA, motherB, mother_len,
+                                             fatherA, fatherB, father_len,
+                                             childA, childB, child_len,
+                                             n_paths, &score, &margins);
   double time = Utils::StopClock();
+  char * consensus = Utils::Expand(compact_consensus, child_columns, original_child_len);
 
   const char * output_filename = "phase_string.txt";
-  Utils::SaveChar(consensus, child_len, (char *)output_filename);
+  Utils::SaveChar(consensus, original_child_len, (char *)output_filename);
+  // Only n_paths 0 has margins; a file left by an earlier run would not
+  // match this phase_string.txt.
+  const char * margins_filename = "phase_margins.txt";
+  if (margins != NULL) {
+    SaveMargins(margins, child_columns, original_child_len, margins_filename);
+    delete[] margins;
+  } else {
+    remove(margins_filename);
+  }
   printf("Similarity score: %i\n", score);
   printf("Took in: %.2f seconds\n", time);
 
@@ -225,5 +319,7 @@ int main(int argc, char ** argv) {
   delete[] fatherB;
   delete[] childA;
   delete[] childB;
+  delete[] compact_consensus;
+  delete[] consensus;
 }
 
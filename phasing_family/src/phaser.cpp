@@ -42,24 +42,58 @@ Phaser::Phaser(char * _M1,
   for (size_t i = 0; i < C_len; i++) {
     phase_string[i] = '?';
   }
+  phase_margins = NULL;
+  M_code[0] = EncodeSequence(M1, M_len);
+  M_code[1] = EncodeSequence(M2, M_len);
+  F_code[0] = EncodeSequence(F1, F_len);
+  F_code[1] = EncodeSequence(F2, F_len);
+  C_code[0] = EncodeSequence(C1, C_len);
+  C_code[1] = EncodeSequence(C2, C_len);
+  pair_scores[PAIR_GAPS] = 0;
+  pair_scores[PAIR_NONE] = 0;
   verbose = false;
+  SetAVX2(true);
+  SetSharedReductions(true);
+  SetSweep(SWEEP_ROWS);
+  SetScoreWidth(WIDTH_AUTO);
+  SetBand(0);
+  SetWavefront(false);
+  SetProjectionBounds(false);
+  SetTraceback(TRACEBACK_AUTO);
+  SetMemoryBudget(0);
+  SetSmallPlanes(1);
+  SetGapRuns(true);
+  SetCollapseHomozygous(true);
+  SetSchemeBudget(SCHEME_BUDGET);
+  runs_collapsed = false;
+  for (size_t x = 0; x < 2; x++) {
+    runs_M[x] = NULL;
+    runs_F[x] = NULL;
+  }
+  saturated = false;
 }
 
 
 // Basic DPA algorithm;
 // O(n^3) time
 // O(n^2) space
+// Score only: no checkpoint is tracked.
 score_t Phaser::similarity() {
-  size_t dumb_i;
-  size_t dumb_j;
-  size_t dumb_k;
-  score_t answer = partial_aligner(0, 0, 0,
-                                   M_len-1, F_len-1, C_len-1,
-                                   &dumb_i, &dumb_j, &dumb_k);
-  return answer;
+  CollapseGapRuns();
+  I_len = M_len;
+  J_len = F_len;
+  score_t last_scores[8];
+  size_t last_i[8];
+  size_t last_j[8];
+  if (!SweepWavefront(0, 0, 0, C_len, C_len/2, last_scores, last_i, last_j) &&
+      !SweepBanded(0, 0, 0, C_len, C_len/2, last_scores, last_i, last_j)) {
+    Sweep(0, 0, 0, C_len, C_len/2, last_scores, NULL);
+  }
+  return *std::max_element(last_scores, last_scores + 8);
 }
 
 score_t Phaser::similarity_and_phase() {
+  CollapseGapRuns();
   score_t ans = aligner(0, 0, 0, M_len-1, F_len-1, C_len-1);
   PrintPhaseString();
   return ans;
@@ -71,6 +105,16 @@ score_t Phaser::aligner(size_t i_ini,
                         size_t i_end,
                         size_t j_end,
                         size_t k_end) {
+  I_len = i_end - i_ini + 1;
+  J_len = j_end - j_ini + 1;
+  size_t K_len = k_end - k_ini + 1;
+  traceback_t engine = PickTraceback(K_len);
+  if (engine == TRACEBACK_FULL) {
+    return TraceAligner(i_ini, j_ini, k_ini, K_len);
+  }
+  if (K_len <= small_planes && SmallFits(K_len)) {
+    return SmallAligner(i_ini, j_ini, k_ini, K_len);
+  }
   size_t i_med, j_med, k_med;
   score_t ans = partial_aligner(i_ini,
                                 j_ini,
@@ -116,11 +160,8 @@ score_t Phaser::aligner(size_t i_ini,
       fprintf(stderr, "Please send us a report.\n");
       exit(-1);
     }
-  } else {
-    if (p1 || p2) {
-      printf("im curious:\n");
-      printf("%lu, %lu, %lu \n", k_ini, k_med, k_end);
-    }
+  } else if (verbose && (p1 || p2)) {
+    fprintf(stderr, "One-sided split: %lu, %lu, %lu\n", k_ini, k_med, k_end);
   }
   return ans;
 }
@@ -140,11 +181,6 @@ score_t Phaser::partial_aligner(size_t i_ini,
   assert(j_end >= j_ini || j_end + 1 == j_ini);
   assert(i_end >= i_ini || i_end + 1 == i_ini);
   assert(k_end >= k_ini);
-  score_t * prev_face[8];
-  score_t * curr_face[8];
-  my_pair * prev_check[8];
-  my_pair * curr_check[8];
-
   // Obs: we will use local i (resp. j, k) from 0 to I_len (J_len, K_len).
   // characters are stracted from i_ini+i (j, k resp.).
   // checkpoint answer is shifted back at the end.
@@ -153,32 +189,181 @@ score_t Phaser::partial_aligner(size_t i_ini,
   J_len = j_end - j_ini + 1;
   size_t K_len = k_end - k_ini + 1;
   size_t mid_k = K_len/2;
-  for (size_t m = 0; m < 8; m++) {
-    prev_face[m] = new score_t[(I_len+1) * (J_len+1)];
-    prev_check[m] = new my_pair[(I_len+1) * (J_len+1)];
+  score_t last_scores[8];
+  // Checkpoints of the 8 states of the last cell.
+  size_t last_i[8];
+  size_t last_j[8];
+  if (!SweepWavefront(i_ini, j_ini, k_ini, K_len, mid_k, last_scores, last_i, last_j) &&
+      !SweepBanded(i_ini, j_ini, k_ini, K_len, mid_k, last_scores, last_i, last_j)) {
+    assert((I_len+1) * (J_len+1) - 1 <= (size_t)UINT32_MAX);
+    check_t last_checks[8];
+    Sweep(i_ini, j_ini, k_ini, K_len, mid_k, last_scores, last_checks);
+    for (int i = 0; i < 8; i++) {
+      assert(last_checks[i] < (I_len+1) * (J_len+1));
+      last_i[i] = CellI(last_checks[i]);
+      last_j[i] = CellJ(last_checks[i]);
+    }
   }
 
-  // 8 points:
-  for (bool cf : {false, true}) {
-    for (bool ff : {false, true}) {
-      for (bool mf : {false, true}) {
-        size_t m = m_index(mf, ff, cf);
-        prev_face[m][IJ(0, 0)] = 0;
-        prev_check[m][IJ(0, 0)] = my_pair(0, 0);
+  // extract max:
+  score_t ans;
+  bool flip_ans;
+  ExtractMax(last_scores, last_i, last_j, &ans, i_med, j_med, &flip_ans);
+
+  // we use char_i = M[i-1]
+  mid_k--;
+  *k_med = k_ini + mid_k;
+  *i_med = i_ini + (*i_med) - 1;
+  *j_med = j_ini + (*j_med) - 1;
+
+  assert(CorrectIniMedEnd(i_ini, *i_med, i_end));
+  assert(CorrectIniMedEnd(j_ini, *j_med, j_end));
+  assert(CorrectIniMedEnd(k_ini, *k_med, k_end));
+
+
+  char phase_char = flip_ans ? '1' : '0';
+  if (phase_string[k_end] != '?') {
+    assert(phase_string[k_end] == phase_char);
+  }
+  if (phase_string[k_end] == '?') {
+    phase_string[k_end] = phase_char;
+  }
+  return ans;
+}
+
+// Runs the engine selected by SetSweep and SetScoreWidth on the sub-cube of
+// size I_len x J_len x K_len. last_checks is NULL when no checkpoint is
+// needed (similarity).
+void Phaser::Sweep(size_t i_ini,
+                   size_t j_ini,
+                   size_t k_ini,
+                   size_t K_len,
+                   size_t mid_k,
+                   score_t * last_scores,
+                   check_t * last_checks) {
+  bool diagonals = false;
+#ifdef __AVX2__
+  diagonals = (sweep == SWEEP_DIAGONALS && use_avx2 && DiagonalsFit());
+#endif
+  bool narrow = (score_width == WIDTH_16) ||
+      (score_width == WIDTH_AUTO && ScoreBound(K_len) <= (size_t)INT16_MAX);
+  // Engines with narrow planes that saturate are rerun with score_t faces.
+  bool done = false;
+  saturated = false;
+  if (diagonals) {
+#ifdef __AVX2__
+    SweepDiagonals(i_ini, j_ini, k_ini, K_len, mid_k, last_scores, last_checks);
+#endif
+    done = true;
+  } else if (sweep == SWEEP_DELTAS && DeltasFit()) {
+    SweepDeltas(i_ini, j_ini, k_ini, K_len, mid_k, last_scores, last_checks);
+    done = !saturated;
+  } else if (narrow) {
+    SweepRows<int16_t>(i_ini, j_ini, k_ini, K_len, mid_k, last_scores, last_checks);
+    done = !saturated;
+  }
+  if (!done) {
+    saturated = false;
+    SweepRows<score_t>(i_ini, j_ini, k_ini, K_len, mid_k, last_scores, last_checks);
+  }
+}
+
+// Sweeps the K_len planes of the sub-cube row by row (j outer, i inner),
+// and returns the 8 states of the last cell (I_len, J_len, K_len).
+// Each plane overwrites the previous one in place.
+template<typename SCORE>
+void Phaser::SweepRows(size_t i_ini,
+                       size_t j_ini,
+                       size_t k_ini,
+                       size_t K_len,
+                       size_t mid_k,
+                       score_t * last_scores,
+                       check_t * last_checks) {
+  bool tracking = (last_checks != NULL);
+  // One plane for the scores and one for the checkpoints, see RollingFace.
+  RollingFace<SCORE> face(I_len, J_len+1);
+  RollingFace<check_t> check(I_len, tracking ? J_len+1 : 0);
+  ScoreProfile profile(I_len, J_len);
+  InitProfile(&profile, i_ini, j_ini);
+
+  FirstPlane(&face, tracking ? &check : NULL, &profile);
+  PrintFace(face.Plane());
+
+  // the rest of the faces:
+  for (size_t k = 1; k <= K_len; k++) {
+    FillProfile(&profile, i_ini, j_ini, k_ini + k-1);
+    // Checkpoints of the planes k < mid_k are never read.
+    bool track = tracking && k >= mid_k;
+    if (!use_avx2 && shared_reductions) {
+      if (!track) {
+        SweepPlane<SCORE, CHECKS_OFF>(&face, &check, &profile);
+      } else if (k == mid_k) {
+        SweepPlane<SCORE, CHECKS_MID>(&face, &check, &profile);
+      } else {
+        SweepPlane<SCORE, CHECKS_COPY>(&face, &check, &profile);
       }
+    } else {
+      for (size_t j = 0; j <= J_len; j++) {
+        for (size_t i = 0; i <= I_len; i++) {
+          Neighbourhood<SCORE> scores;
+          Neighbourhood<check_t> checks = Neighbourhood<check_t>();
+          face.Roll(i, j, &scores);
+          if (track) {
+            check.Roll(i, j, &checks);
+            UpdateCell<SCORE, true>(&scores, &checks, &profile, i, j, k, mid_k);
+          } else {
+            UpdateCell<SCORE, false>(&scores, &checks, &profile, i, j, k, mid_k);
+          }
+        }
+        face.EndRow();
+        if (track) {
+          check.EndRow();
+        }
+      }
+    }
+
+    if (saturated) {
+      // partial_aligner reruns the sweep with score_t.
+      return;
+    }
+    if (k >= mid_k) {
+      // verbose = true;
     }
+    PrintFace(face.Plane());
+    if (tracking) {
+      PrintCheck(check.Plane());
+    }
+  }
+
+  std::copy(face.Cell(I_len, J_len), face.Cell(I_len, J_len) + 8, last_scores);
+  if (tracking) {
+    std::copy(check.Cell(I_len, J_len), check.Cell(I_len, J_len) + 8, last_checks);
+  }
+}
+
+// The plane k = 0 of the sub-cube: only insertions from the parents. Also
+// used by the engines that sweep their own planes. check is NULL when there
+// are no checkpoints.
+template<typename SCORE>
+void Phaser::FirstPlane(RollingFace<SCORE> * face,
+                        RollingFace<check_t> * check,
+                        ScoreProfile * profile) {
+  // 8 points:
+  for (size_t m = 0; m < 8; m++) {
+    face->Cell(0, 0)[m] = 0;
   }
 
   // 8 lines (j=0):
   for (size_t i = 1; i <= I_len; i++) {
+    SCORE * cell_scores = face->Cell(i, 0);
+    SCORE * left_scores = face->Cell(i-1, 0);
     for (bool cf : {false, true}) {
       for (bool ff : {false, true}) {
         for (bool mf : {false, true}) {
           size_t m = m_index(mf, ff, cf);
-          char m_char = mf ? M2[i_ini + i-1] : M1[i_ini + i-1];
-          prev_face[m][IJ(i, 0)] = std::max(prev_face[m_index(0, ff, cf)][IJ(i-1, 0)] + score(m_char, '-'),  //  NOLINT
-                                            prev_face[m_index(1, ff, cf)][IJ(i-1, 0)] + score(m_char, '-'));  //  NOLINT
-          prev_check[m][IJ(i, 0)] = my_pair(i, 0);
+          cell_scores[m] = Narrow<SCORE>(std::max(left_scores[m_index(0, ff, cf)] + profile->m_ins[mf][i],
+                                                  left_scores[m_index(1, ff, cf)] + profile->m_ins[mf][i]),
+                                         &saturated);
         }
       }
     }
@@ -187,175 +372,136 @@ score_t Phaser::partial_aligner(size_t i_ini,
   // 8 faces:
   for (size_t j = 1; j <= J_len; j++) {
     for (size_t i = 0; i <= I_len; i++) {
+      SCORE * cell_scores = face->Cell(i, j);
+      SCORE * down_scores = face->Cell(i, j-1);
       for (bool cf : {false, true}) {
         for (bool ff : {false, true}) {
           for (bool mf : {false, true}) {
             size_t m = m_index(mf, ff, cf);
-            char f_char = ff ? F2[j_ini + j-1] : F1[j_ini + j-1];
-            prev_face[m][IJ(i, j)] = std::max(prev_face[m_index(mf, 0, cf)][IJ(i, j-1)] + score(f_char, '-'),  //  NOLINT
-                                              prev_face[m_index(mf, 1, cf)][IJ(i, j-1)] + score(f_char, '-'));  //  NOLINT
-            prev_check[m][IJ(i, j)] = my_pair(i, j);
+            cell_scores[m] = Narrow<SCORE>(std::max(down_scores[m_index(mf, 0, cf)] + profile->f_ins[ff][j],
+                                                    down_scores[m_index(mf, 1, cf)] + profile->f_ins[ff][j]),
+                                           &saturated);
           }
         }
       }
     }
   }
-  PrintFace(prev_face);
-
-  bool malloc_opt = true;
-  if (malloc_opt) {
-    for (size_t m = 0; m < 8; m++) {
-      curr_face[m] = new score_t[(I_len+1) * (J_len+1)];
-      curr_check[m] = new my_pair[(I_len+1) * (J_len+1)];
+  // Every cell of the plane 0 is its own checkpoint.
+  for (size_t j = 0; check != NULL && j <= J_len; j++) {
+    for (size_t i = 0; i <= I_len; i++) {
+      std::fill(check->Cell(i, j), check->Cell(i, j) + 8, CellId(i, j));
     }
   }
+}
 
-  // the rest of the faces:
-  for (size_t k = 1; k <= K_len; k++) {
-    if (!malloc_opt) {
-      for (size_t m = 0; m < 8; m++) {
-        curr_face[m] = new score_t[(I_len+1) * (J_len+1)];
-        curr_check[m] = new my_pair[(I_len+1) * (J_len+1)];
-      }
-    }
-    for (size_t j = 0; j <= J_len; j++) {
-      for (size_t i = 0; i <= I_len; i++) {
-        for (bool cf : {false, true}) {
-          for (bool ff : {false, true}) {
-            for (bool mf : {false, true}) {
-              // m_char anf f_char should not be used, at least i > 0  (j > 0).
-              // If that is not the case, we initilize with a non-accepted character that
-              // will trig an error if used.
-              char m_char, f_char;
-              if (i > 0) {
-                m_char = mf ? M2[i_ini + i-1] : M1[i_ini + i-1];
-              } else {
-                m_char = 'J';  // Not in gen alphabet, will trigger an error if used.
-              }
-              if (j > 0) {
-                f_char = ff ? F2[j_ini + j-1] : F1[j_ini + j-1];
-              } else {
-                f_char = 'J';  // Not in gen alphabet, will trigger an error if used.
-              }
-
-              char c_1    = cf ? C2[k_ini + k-1] : C1[k_ini + k-1];
-              char c_2    = cf ? C1[k_ini + k-1] : C2[k_ini + k-1];
-
-              UpdateGeneral(curr_face,
-                            prev_face,
-                            curr_check,
-                            prev_check,
-                            i,
-                            j,
-                            k,
-                            mid_k,
-                            mf,
-                            ff,
-                            cf,
-                            m_char,
-                            f_char,
-                            c_1,
-                            c_2);
-            }
-          }
-        }
-      }
-    }
+template void Phaser::FirstPlane<int16_t>(RollingFace<int16_t> *, RollingFace<check_t> *, ScoreProfile *);
+template void Phaser::FirstPlane<score_t>(RollingFace<score_t> *, RollingFace<check_t> *, ScoreProfile *);
 
-    for (size_t m = 0; m < 8; m++) {
-      if (malloc_opt) {
-        score_t * tmp_face = prev_face[m];
-        my_pair * tmp_check = prev_check[m];
-        prev_face[m] = curr_face[m];
-        prev_check[m] = curr_check[m];
-        curr_face[m] = tmp_face;
-        curr_check[m] = tmp_check;
-      } else {        delete[] (prev_face[m]);
-        delete[] (prev_check[m]);
-        prev_face[m] = curr_face[m];
-        prev_check[m] = curr_check[m];
-      }
+// Entry 0 of the profile is the boundary of the sub-cube,
+// scored as CODE_BOUNDARY (always 0, never a gap).
+void Phaser::InitProfile(ScoreProfile * profile, size_t i_ini, size_t j_ini) {
+  for (bool x : {false, true}) {
+    for (size_t i = 0; i <= I_len; i++) {
+      code_t m_code = (i > 0) ? M_code[x][i_ini + i-1] : CODE_BOUNDARY;
+      profile->m_ins[x][i] = score(m_code, CODE_GAP);
+      profile->m_gap[x][i] = (m_code == CODE_GAP) ? -1 : 0;
     }
-    if (k >= mid_k) {
-      // verbose = true;
+    for (size_t j = 0; j <= J_len; j++) {
+      code_t f_code = (j > 0) ? F_code[x][j_ini + j-1] : CODE_BOUNDARY;
+      profile->f_ins[x][j] = score(f_code, CODE_GAP);
+      profile->f_gap[x][j] = (f_code == CODE_GAP) ? -1 : 0;
     }
-    PrintFace(prev_face);
-    PrintCheck(prev_check);
-  }
-
-  // we use char_i = M[i-1]
-  for (int i = 0; i < 8; i++) {
-    assert(prev_check[i][IJ(I_len, J_len)].first <= I_len);
-    assert(prev_check[i][IJ(I_len, J_len)].second <= J_len);
-
-    prev_check[i][IJ(I_len, J_len)].first--;
-    prev_check[i][IJ(I_len, J_len)].second--;
   }
-  mid_k--;
-
-
-  // extract max:
-  score_t ans;
-  bool flip_ans;
-  ExtractMax(prev_face, prev_check, &ans, i_med, j_med, &flip_ans);
-  *k_med = k_ini + mid_k;
-  *i_med = i_ini + (*i_med);
-  *j_med = j_ini + (*j_med);
-
-  assert(CorrectIniMedEnd(i_ini, *i_med, i_end));
-  assert(CorrectIniMedEnd(j_ini, *j_med, j_end));
-  assert(CorrectIniMedEnd(k_ini, *k_med, k_end));
-
-
-  char phase_char = flip_ans ? '1' : '0';
-  if (phase_string[k_end] != '?') {
-    assert(phase_string[k_end] == phase_char);
+  // Homozygous columns, see UpdateFixed.
+  for (size_t i = 1; i <= I_len; i++) {
+    size_t x = i_ini + i-1;
+    profile->m_same[i] = SameSymbol(M_code[0][x], M_code[1][x], M1[x], M2[x]) ? -1 : 0;
   }
-  if (phase_string[k_end] == '?') {
-    phase_string[k_end] = phase_char;
+  for (size_t j = 1; j <= J_len; j++) {
+    size_t y = j_ini + j-1;
+    profile->f_same[j] = SameSymbol(F_code[0][y], F_code[1][y], F1[y], F2[y]) ? -1 : 0;
   }
+}
 
-  for (size_t m = 0; m < 8; m++) {
-    delete[] (prev_face[m]);
-    delete[] (prev_check[m]);
-    if (malloc_opt) {
-      delete[] (curr_face[m]);
-      delete[] (curr_check[m]);
+void Phaser::FillProfile(ScoreProfile * profile,
+                         size_t i_ini,
+                         size_t j_ini,
+                         size_t k) {
+  FillProfile(profile, i_ini, j_ini, k, 0, I_len, 0, J_len);
+}
+
+void Phaser::FillProfile(ScoreProfile * profile,
+                         size_t i_ini,
+                         size_t j_ini,
+                         size_t k,
+                         size_t i_lo,
+                         size_t i_hi,
+                         size_t j_lo,
+                         size_t j_hi) {
+  for (bool cf : {false, true}) {
+    code_t c_1 = C_code[cf][k];
+    code_t c_2 = C_code[!cf][k];
+    char c_char_1 = cf ? C2[k] : C1[k];
+    char c_char_2 = cf ? C1[k] : C2[k];
+    for (bool x : {false, true}) {
+      char * M = x ? M2 : M1;
+      char * F = x ? F2 : F1;
+      score_t * m_align = profile->m_align[cf][x];
+      score_t * f_align = profile->f_align[cf][x];
+      if (i_lo == 0) {
+        m_align[0] = score(c_1, CODE_BOUNDARY);
+      }
+      for (size_t i = std::max(i_lo, (size_t)1); i <= i_hi; i++) {
+        m_align[i] = score(c_1, M_code[x][i_ini + i-1], c_char_1, M[i_ini + i-1]);
+      }
+      if (j_lo == 0) {
+        f_align[0] = score(c_2, CODE_BOUNDARY);
+      }
+      for (size_t j = std::max(j_lo, (size_t)1); j <= j_hi; j++) {
+        f_align[j] = score(c_2, F_code[x][j_ini + j-1], c_char_2, F[j_ini + j-1]);
+      }
     }
+    profile->m_del[cf] = score(c_2, CODE_GAP);
+    profile->f_del[cf] = score(c_1, CODE_GAP);
   }
-  return ans;
+  profile->c_del = score(C_code[0][k], CODE_GAP) + score(C_code[1][k], CODE_GAP);
+  profile->c_same = SameSymbol(C_code[0][k], C_code[1][k], C1[k], C2[k]);
 }
 
-// TODO(possible optimization):
-// To have two versions, one that keep track,
-// and one who does not, to avoid some work for k < mid_k ?
+// Checkpoint m of a neighbour, or 0 when the kernel does not track them.
+template<bool TRACK>
+static inline check_t CheckOf(const check_t * checks, size_t m) {
+  return TRACK ? checks[m] : 0;
+}
 
 // With the current scheme we store the larger i, j
 // that can be aligned to mid_k in the optimal alignment.
-void Phaser::UpdateGeneral(score_t ** curr_face,
-                           score_t ** prev_face,
-                           my_pair ** curr_check,
-                           my_pair ** prev_check,
+// TRACK is false for the planes k < mid_k and for similarity(),
+// where no checkpoint is ever read.
+template<typename SCORE, bool TRACK>
+void Phaser::UpdateGeneral(Neighbourhood<SCORE> * scores,
+                           Neighbourhood<check_t> * checks,
+                           ScoreProfile * profile,
                            size_t i,
                            size_t j,
                            size_t k,
                            size_t mid_k,
                            bool mf,
                            bool ff,
-                           bool cf,
-                           char m_char,
-                           char f_char,
-                           char c_1,
-                           char c_2) {
+                           bool cf) {
   size_t m = m_index(mf, ff, cf);
   score_t max_score;
-  my_pair max_check;
+  check_t max_check = 0;
+  SCORE * curr_scores = scores->curr;
+  check_t * curr_checks = checks->curr;
 
   // only k decreases. Two deletions from C.
-  score_t c_ins_1 =  prev_face[m_index(mf, ff, 0)][IJ(i, j)] + score(c_1, '-') + score(c_2, '-');
-  score_t c_ins_2 =  prev_face[m_index(mf, ff, 1)][IJ(i, j)] + score(c_1, '-') + score(c_2, '-');
-  my_pair check_1 = prev_check[m_index(mf, ff, 0)][IJ(i, j)];
-  my_pair check_2 = prev_check[m_index(mf, ff, 1)][IJ(i, j)];
+  SCORE * back_scores = scores->back;
+  check_t * back_checks = checks->back;
+  score_t c_ins_1 =  back_scores[m_index(mf, ff, 0)] + profile->c_del;
+  score_t c_ins_2 =  back_scores[m_index(mf, ff, 1)] + profile->c_del;
+  check_t check_1 = CheckOf<TRACK>(back_checks, m_index(mf, ff, 0));
+  check_t check_2 = CheckOf<TRACK>(back_checks, m_index(mf, ff, 1));
 
   if (c_ins_1 >= c_ins_2) {
     max_score = c_ins_1;
@@ -366,99 +512,435 @@ void Phaser::UpdateGeneral(score_t ** curr_face,
   }
 
   if (i > 0) {
-    if (m_char == '-') {
-      score_t p1 = curr_face[m_index(0, ff, cf)][IJ(i-1, j)];
-      score_t p2 = curr_face[m_index(1, ff, cf)][IJ(i-1, j)];
-      curr_face[m][IJ(i, j)] = std::max(p1, p2);
-      if (k == mid_k) {
-        curr_check[m][IJ(i, j)] = my_pair(i, j);
-      } else if (k > mid_k) {
-        curr_check[m][IJ(i, j)] = (p1 > p2) ?
-            curr_check[m_index(0, ff, cf)][IJ(i-1, j)] :
-            curr_check[m_index(1, ff, cf)][IJ(i-1, j)];
+    SCORE * left_scores = scores->left;
+    check_t * left_checks = checks->left;
+    if (profile->m_gap[mf][i]) {
+      score_t p1 = left_scores[m_index(0, ff, cf)];
+      score_t p2 = left_scores[m_index(1, ff, cf)];
+      curr_scores[m] = static_cast<SCORE>(std::max(p1, p2));
+      if (TRACK && k == mid_k) {
+        curr_checks[m] = CellId(i, j);
+      } else if (TRACK && k > mid_k) {
+        curr_checks[m] = (p1 > p2) ?
+            CheckOf<TRACK>(left_checks, m_index(0, ff, cf)) :
+            CheckOf<TRACK>(left_checks, m_index(1, ff, cf));
       }
       return;
     }
     // only i decreases. Single deletion from M.
     // TODO(Readability): This might be a one-level for over pre_mf.
     score_t ins_val;
-    my_pair ins_check;
-    ins_val   =  curr_face[m_index(0, ff, cf)][IJ(i-1, j)] + score(m_char, '-');
-    ins_check = curr_check[m_index(0, ff, cf)][IJ(i-1, j)];
+    check_t ins_check;
+    ins_val   =  left_scores[m_index(0, ff, cf)] + profile->m_ins[mf][i];
+    ins_check = CheckOf<TRACK>(left_checks, m_index(0, ff, cf));
     UpdateVals(ins_val, ins_check, &max_score, &max_check);
 
-    ins_val  =   curr_face[m_index(1, ff, cf)][IJ(i-1, j)] + score(m_char, '-');
-    ins_check = curr_check[m_index(1, ff, cf)][IJ(i-1, j)];
+    ins_val  =   left_scores[m_index(1, ff, cf)] + profile->m_ins[mf][i];
+    ins_check = CheckOf<TRACK>(left_checks, m_index(1, ff, cf));
     UpdateVals(ins_val, ins_check, &max_score, &max_check);
 
     // k and i decreases: single deletions from C, M aligns.
+    SCORE * back_left_scores = scores->back_left;
+    check_t * back_left_checks = checks->back_left;
+    score_t del_term = profile->m_align[cf][mf][i] + profile->m_del[cf];
     for (bool pre_cf : {false, true}) {
       for (bool pre_mf : {false, true}) {
-        score_t del_val  =   prev_face[m_index(pre_mf, ff, pre_cf)][IJ(i-1, j)] + score(c_1, m_char) + score(c_2, '-');  //  NOLINT
-        my_pair del_check = prev_check[m_index(pre_mf, ff, pre_cf)][IJ(i-1, j)];
+        score_t del_val  =   back_left_scores[m_index(pre_mf, ff, pre_cf)] + del_term;
+        check_t del_check = CheckOf<TRACK>(back_left_checks, m_index(pre_mf, ff, pre_cf));
         UpdateVals(del_val, del_check, &max_score, &max_check);
       }
     }
   }
 
   if (j > 0) {
-    if (f_char == '-') {
-      score_t p1 = curr_face[m_index(mf, 0, cf)][IJ(i, j-1)];
-      score_t p2 = curr_face[m_index(mf, 1, cf)][IJ(i, j-1)];
-      curr_face[m][IJ(i, j)] = std::max(p1, p2);
-      if (k == mid_k) {
-        curr_check[m][IJ(i, j)] = my_pair(i, j);
-      } else if (k > mid_k) {
-        curr_check[m][IJ(i, j)] = (p1 > p2) ?
-            curr_check[m_index(mf, 0, cf)][IJ(i, j-1)] :
-            curr_check[m_index(mf, 1, cf)][IJ(i, j-1)];
+    SCORE * down_scores = scores->down;
+    check_t * down_checks = checks->down;
+    if (profile->f_gap[ff][j]) {
+      score_t p1 = down_scores[m_index(mf, 0, cf)];
+      score_t p2 = down_scores[m_index(mf, 1, cf)];
+      curr_scores[m] = static_cast<SCORE>(std::max(p1, p2));
+      if (TRACK && k == mid_k) {
+        curr_checks[m] = CellId(i, j);
+      } else if (TRACK && k > mid_k) {
+        curr_checks[m] = (p1 > p2) ?
+            CheckOf<TRACK>(down_checks, m_index(mf, 0, cf)) :
+            CheckOf<TRACK>(down_checks, m_index(mf, 1, cf));
       }
       return;
     }
     score_t ins_val;
-    my_pair ins_check;
+    check_t ins_check;
     // only j decreases. Single deletion from F.
-    ins_val = curr_face[m_index(mf, 0, cf)][IJ(i, j-1)] + score(f_char, '-');
-    ins_check = curr_check[m_index(mf, 0, cf)][IJ(i, j-1)];
+    ins_val = down_scores[m_index(mf, 0, cf)] + profile->f_ins[ff][j];
+    ins_check = CheckOf<TRACK>(down_checks, m_index(mf, 0, cf));
     UpdateVals(ins_val, ins_check, &max_score, &max_check);
 
-    ins_val = curr_face[m_index(mf, 1, cf)][IJ(i, j-1)] + score(f_char, '-');
-    ins_check = curr_check[m_index(mf, 1, cf)][IJ(i, j-1)];
+    ins_val = down_scores[m_index(mf, 1, cf)] + profile->f_ins[ff][j];
+    ins_check = CheckOf<TRACK>(down_checks, m_index(mf, 1, cf));
     UpdateVals(ins_val, ins_check, &max_score, &max_check);
 
 
     // k and j decreases: single deletions from C, F aligns.
+    SCORE * back_down_scores = scores->back_down;
+    check_t * back_down_checks = checks->back_down;
+    score_t del_term = profile->f_align[cf][ff][j] + profile->f_del[cf];
     for (bool pre_cf : {false, true}) {
       for (bool pre_ff : {false, true}) {
-        score_t del_val =   prev_face[m_index(mf, pre_ff, pre_cf)][IJ(i, j-1)] + score(c_1, '-') + score(c_2, f_char);  //  NOLINT
-        my_pair del_check = prev_check[m_index(mf, pre_ff, pre_cf)][IJ(i, j-1)];
+        score_t del_val =   back_down_scores[m_index(mf, pre_ff, pre_cf)] + del_term;
+        check_t del_check = CheckOf<TRACK>(back_down_checks, m_index(mf, pre_ff, pre_cf));
         UpdateVals(del_val, del_check, &max_score, &max_check);
       }
     }
   }
 
   if (i > 0 && j > 0) {
+    SCORE * back_diag_scores = scores->back_diag;
+    check_t * back_diag_checks = checks->back_diag;
+    score_t aln_term = profile->m_align[cf][mf][i] + profile->f_align[cf][ff][j];
     for (bool pre_cf : {false, true}) {
       for (bool pre_ff : {false, true}) {
         for (bool pre_mf : {false, true}) {
-          score_t aln_val = prev_face[m_index(pre_mf, pre_ff, pre_cf)][IJ(i-1, j-1)] + score(c_1, m_char) + score(c_2, f_char);  //  NOLINT
-          my_pair aln_check = prev_check[m_index(pre_mf, pre_ff, pre_cf)][IJ(i-1, j-1)];
+          score_t aln_val = back_diag_scores[m_index(pre_mf, pre_ff, pre_cf)] + aln_term;
+          check_t aln_check = CheckOf<TRACK>(back_diag_checks, m_index(pre_mf, pre_ff, pre_cf));
           UpdateVals(aln_val, aln_check, &max_score, &max_check);
         }
       }
     }  }
 
-  curr_face[m][IJ(i, j)] = max_score;
+  curr_scores[m] = Narrow<SCORE>(max_score, &saturated);
 
-  if (k == mid_k) {
-    curr_check[m][IJ(i, j)] = my_pair(i, j);
-  } else if (k > mid_k) {
-    curr_check[m][IJ(i, j)] = max_check;
+  if (TRACK && k == mid_k) {
+    curr_checks[m] = CellId(i, j);
+  } else if (TRACK && k > mid_k) {
+    curr_checks[m] = max_check;
   }
 }
 
+// Every group of candidates of UpdateGeneral has the same predecessors for
+// several states, and adds a term that does not depend on the predecessor.
+// So its first maximum is found once, and then offered to each state in the
+// order of UpdateGeneral: scores and checkpoints are the same.
+//
+// Where M1[i] == M2[i], every move into (i, j, k) either takes the best mf
+// of its predecessor, or keeps mf from a cell with the same i; so by
+// induction the states mf = 0, 1 of the whole column i hold the same scores
+// and checkpoints. The same holds for ff where F1[j] == F2[j], and for cf in
+// a plane where C1[k] == C2[k]. The bits of SKIP name the flags that are
+// homozygous here: only the states without them are computed, the others
+// are copied, 4 or 2 states in the long homozygous stretches instead of 8.
+template<typename SCORE, check_phase_t PHASE, cell_kind_t CELL, size_t SKIP>
+void Phaser::UpdateFixed(Neighbourhood<SCORE> * scores,
+                         Neighbourhood<check_t> * checks,
+                         ScoreProfile * profile,
+                         size_t i,
+                         size_t j) {
+  const bool TRACK = (PHASE == CHECKS_COPY);
+  const bool HAS_LEFT = (CELL == CELL_ROW_0 || CELL == CELL_INNER);
+  const bool HAS_DOWN = (CELL == CELL_COL_0 || CELL == CELL_INNER);
+  score_t max_score[8];
+  check_t max_check[8];
+  // States that copy the best neighbour, as their parent symbol is a gap.
+  bool gap[8] = {false, false, false, false, false, false, false, false};
+
+  // only k decreases. Two deletions from C, pre_cf = 0 on ties.
+  SCORE * back_scores = scores->back;
+  for (size_t m = 0; m < 4; m++) {
+    if (m & SKIP) {
+      continue;
+    }
+    size_t best = (back_scores[m] >= back_scores[m + 4]) ? m : m + 4;
+    for (size_t cf = 0; cf < 2 - ((SKIP >> 2) & 1); cf++) {
+      max_score[m + 4*cf] = back_scores[best] + profile->c_del;
+      max_check[m + 4*cf] = CheckOf<TRACK>(checks->back, best);
+    }
+  }
+
+  if (HAS_LEFT) {
+    SCORE * left_scores = scores->left;
+    for (bool cf : {false, true}) {
+      for (bool ff : {false, true}) {
+        size_t pre_1 = m_index(0, ff, cf);
+        size_t pre_2 = m_index(1, ff, cf);
+        if (pre_1 & SKIP) {
+          continue;
+        }
+        // Insertions keep the first maximum, gap copies the last one.
+        size_t ins_best = (left_scores[pre_2] > left_scores[pre_1]) ? pre_2 : pre_1;
+        size_t gap_best = (left_scores[pre_1] > left_scores[pre_2]) ? pre_1 : pre_2;
+        for (bool mf : {false, true}) {
+          size_t m = m_index(mf, ff, cf);
+          if (m & SKIP) {
+            continue;
+          }
+          if (profile->m_gap[mf][i]) {
+            gap[m] = true;
+            max_score[m] = left_scores[gap_best];
+            max_check[m] = CheckOf<TRACK>(checks->left, gap_best);
+          } else {
+            UpdateVals(left_scores[ins_best] + profile->m_ins[mf][i],
+                       CheckOf<TRACK>(checks->left, ins_best), &max_score[m], &max_check[m]);
+          }
+        }
+      }
+    }
+    // k and i decreases: the best (pre_cf, pre_mf) of each ff.
+    SCORE * back_left_scores = scores->back_left;
+    for (bool ff : {false, true}) {
+      if (m_index(0, ff, 0) & SKIP) {
+        continue;
+      }
+      size_t best = m_index(0, ff, 0);
+      for (bool pre_cf : {false, true}) {
+        for (bool pre_mf : {false, true}) {
+          size_t pre = m_index(pre_mf, ff, pre_cf);
+          best = (back_left_scores[pre] > back_left_scores[best]) ? pre : best;
+        }
+      }
+      for (bool cf : {false, true}) {
+        for (bool mf : {false, true}) {
+          size_t m = m_index(mf, ff, cf);
+          if (!(m & SKIP) && !gap[m]) {
+            UpdateVals(back_left_scores[best] + profile->m_align[cf][mf][i] + profile->m_del[cf],
+                       CheckOf<TRACK>(checks->back_left, best), &max_score[m], &max_check[m]);
+          }
+        }
+      }
+    }
+  }
+
+  if (HAS_DOWN) {
+    SCORE * down_scores = scores->down;
+    for (bool cf : {false, true}) {
+      for (bool mf : {false, true}) {
+        size_t pre_1 = m_index(mf, 0, cf);
+        size_t pre_2 = m_index(mf, 1, cf);
+        if (pre_1 & SKIP) {
+          continue;
+        }
+        size_t ins_best = (down_scores[pre_2] > down_scores[pre_1]) ? pre_2 : pre_1;
+        size_t gap_best = (down_scores[pre_1] > down_scores[pre_2]) ? pre_1 : pre_2;
+        for (bool ff : {false, true}) {
+          size_t m = m_index(mf, ff, cf);
+          if ((m & SKIP) || gap[m]) {
+            continue;
+          }
+          if (profile->f_gap[ff][j]) {
+            gap[m] = true;
+            max_score[m] = down_scores[gap_best];
+            max_check[m] = CheckOf<TRACK>(checks->down, gap_best);
+          } else {
+            UpdateVals(down_scores[ins_best] + profile->f_ins[ff][j],
+                       CheckOf<TRACK>(checks->down, ins_best), &max_score[m], &max_check[m]);
+          }
+        }
+      }
+    }
+    // k and j decreases: the best (pre_cf, pre_ff) of each mf.
+    SCORE * back_down_scores = scores->back_down;
+    for (bool mf : {false, true}) {
+      if (m_index(mf, 0, 0) & SKIP) {
+        continue;
+      }
+      size_t best = m_index(mf, 0, 0);
+      for (bool pre_cf : {false, true}) {
+        for (bool pre_ff : {false, true}) {
+          size_t pre = m_index(mf, pre_ff, pre_cf);
+          best = (back_down_scores[pre] > back_down_scores[best]) ? pre : best;
+        }
+      }
+      for (bool cf : {false, true}) {
+        for (bool ff : {false, true}) {
+          size_t m = m_index(mf, ff, cf);
+          if (!(m & SKIP) && !gap[m]) {
+            UpdateVals(back_down_scores[best] + profile->f_align[cf][ff][j] + profile->f_del[cf],
+                       CheckOf<TRACK>(checks->back_down, best), &max_score[m], &max_check[m]);
+          }
+        }
+      }
+    }
+  }
+
+  if (HAS_LEFT && HAS_DOWN) {
+    // The best of all 8 states, for every state.
+    SCORE * back_diag_scores = scores->back_diag;
+    size_t best = 0;
+    for (size_t pre = 1; pre < 8; pre++) {
+      best = (back_diag_scores[pre] > back_diag_scores[best]) ? pre : best;
+    }
+    for (bool cf : {false, true}) {
+      for (bool ff : {false, true}) {
+        for (bool mf : {false, true}) {
+          size_t m = m_index(mf, ff, cf);
+          if (!(m & SKIP) && !gap[m]) {
+            UpdateVals(back_diag_scores[best] + profile->m_align[cf][mf][i] + profile->f_align[cf][ff][j],
+                       CheckOf<TRACK>(checks->back_diag, best), &max_score[m], &max_check[m]);
+          }
+        }
+      }
+    }
+  }
+
+  for (size_t m = 0; m < 8; m++) {
+    size_t from = m & ~SKIP;
+    scores->curr[m] = (m & SKIP) ? scores->curr[from] : Narrow<SCORE>(max_score[m], &saturated);
+    if (PHASE == CHECKS_MID) {
+      checks->curr[m] = CellId(i, j);
+    } else if (PHASE == CHECKS_COPY) {
+      checks->curr[m] = (m & SKIP) ? checks->curr[from] : max_check[m];
+    }
+  }
+}
+
+// UpdateFixed of an inner cell, with the states that skip chooses.
+template<typename SCORE, check_phase_t PHASE>
+void Phaser::UpdateInner(Neighbourhood<SCORE> * scores,
+                         Neighbourhood<check_t> * checks,
+                         ScoreProfile * profile,
+                         size_t i,
+                         size_t j,
+                         size_t skip) {
+  switch (skip) {
+    case 1:
+      UpdateFixed<SCORE, PHASE, CELL_INNER, 1>(scores, checks, profile, i, j);
+      break;
+    case 2:
+      UpdateFixed<SCORE, PHASE, CELL_INNER, 2>(scores, checks, profile, i, j);
+      break;
+    case 3:
+      UpdateFixed<SCORE, PHASE, CELL_INNER, 3>(scores, checks, profile, i, j);
+      break;
+    case 4:
+      UpdateFixed<SCORE, PHASE, CELL_INNER, 4>(scores, checks, profile, i, j);
+      break;
+    case 5:
+      UpdateFixed<SCORE, PHASE, CELL_INNER, 5>(scores, checks, profile, i, j);
+      break;
+    case 6:
+      UpdateFixed<SCORE, PHASE, CELL_INNER, 6>(scores, checks, profile, i, j);
+      break;
+    case 7:
+      UpdateFixed<SCORE, PHASE, CELL_INNER, 7>(scores, checks, profile, i, j);
+      break;
+    default:
+      UpdateFixed<SCORE, PHASE, CELL_INNER, 0>(scores, checks, profile, i, j);
+      break;
+  }
+}
+
+template<typename SCORE, check_phase_t PHASE>
+void Phaser::UpdateShared(Neighbourhood<SCORE> * scores,
+                          Neighbourhood<check_t> * checks,
+                          ScoreProfile * profile,
+                          size_t i,
+                          size_t j) {
+  if (i > 0 && j > 0) {
+    UpdateInner<SCORE, PHASE>(scores, checks, profile, i, j, Skip(profile, i, j));
+  } else if (i > 0) {
+    UpdateFixed<SCORE, PHASE, CELL_ROW_0>(scores, checks, profile, i, j);
+  } else if (j > 0) {
+    UpdateFixed<SCORE, PHASE, CELL_COL_0>(scores, checks, profile, i, j);
+  } else {
+    UpdateFixed<SCORE, PHASE, CELL_CORNER>(scores, checks, profile, i, j);
+  }
+}
+
+template<typename SCORE, bool TRACK>
+void Phaser::UpdateShared(Neighbourhood<SCORE> * scores,
+                          Neighbourhood<check_t> * checks,
+                          ScoreProfile * profile,
+                          size_t i,
+                          size_t j,
+                          size_t k,
+                          size_t mid_k) {
+  if (TRACK && k == mid_k) {
+    UpdateShared<SCORE, CHECKS_MID>(scores, checks, profile, i, j);
+  } else if (TRACK && k > mid_k) {
+    UpdateShared<SCORE, CHECKS_COPY>(scores, checks, profile, i, j);
+  } else {
+    UpdateShared<SCORE, CHECKS_OFF>(scores, checks, profile, i, j);
+  }
+}
+
+template<typename SCORE, check_phase_t PHASE>
+void Phaser::SweepPlane(RollingFace<SCORE> * face,
+                        RollingFace<check_t> * check,
+                        ScoreProfile * profile) {
+  Neighbourhood<SCORE> scores;
+  Neighbourhood<check_t> checks = Neighbourhood<check_t>();
+  // j = 0:
+  face->Roll(0, 0, &scores);
+  if (PHASE != CHECKS_OFF) {
+    check->Roll(0, 0, &checks);
+  }
+  UpdateFixed<SCORE, PHASE, CELL_CORNER>(&scores, &checks, profile, 0, 0);
+  for (size_t i = 1; i <= I_len; i++) {
+    face->Roll(i, 0, &scores);
+    if (PHASE != CHECKS_OFF) {
+      check->Roll(i, 0, &checks);
+    }
+    UpdateFixed<SCORE, PHASE, CELL_ROW_0>(&scores, &checks, profile, i, 0);
+  }
+  face->EndRow();
+  if (PHASE != CHECKS_OFF) {
+    check->EndRow();
+  }
+
+  for (size_t j = 1; j <= J_len; j++) {
+    face->Roll(0, j, &scores);
+    if (PHASE != CHECKS_OFF) {
+      check->Roll(0, j, &checks);
+    }
+    UpdateFixed<SCORE, PHASE, CELL_COL_0>(&scores, &checks, profile, 0, j);
+    for (size_t i = 1; i <= I_len; i++) {
+      face->RollInner(i, j, &scores);
+      if (PHASE != CHECKS_OFF) {
+        check->RollInner(i, j, &checks);
+      }
+      UpdateInner<SCORE, PHASE>(&scores, &checks, profile, i, j, Skip(profile, i, j));
+    }
+    face->EndRow();
+    if (PHASE != CHECKS_OFF) {
+      check->EndRow();
+    }
+  }
+}
+
+// Also used by the traceback engines.
+template void Phaser::SweepPlane<int16_t, CHECKS_OFF>(RollingFace<int16_t> *, RollingFace<check_t> *,
+                                                      ScoreProfile *);
+template void Phaser::SweepPlane<score_t, CHECKS_OFF>(RollingFace<score_t> *, RollingFace<check_t> *,
+                                                      ScoreProfile *);
+
+// Also used by SweepDeltas.
+template void Phaser::UpdateGeneral<score_t, false>(Neighbourhood<score_t> *, Neighbourhood<check_t> *,
+                                                    ScoreProfile *, size_t, size_t, size_t, size_t,
+                                                    bool, bool, bool);
+template void Phaser::UpdateShared<score_t, false>(Neighbourhood<score_t> *, Neighbourhood<check_t> *,
+                                                   ScoreProfile *, size_t, size_t, size_t, size_t);
+template void Phaser::UpdateShared<score_t, true>(Neighbourhood<score_t> *, Neighbourhood<check_t> *,
+                                                  ScoreProfile *, size_t, size_t, size_t, size_t);
+template void Phaser::UpdateGeneral<score_t, true>(Neighbourhood<score_t> *, Neighbourhood<check_t> *,
+                                                   ScoreProfile *, size_t, size_t, size_t, size_t,
+                                                   bool, bool, bool);
+// And by the traceback engines on narrow scores.
+template void Phaser::UpdateGeneral<int16_t, false>(Neighbourhood<int16_t> *, Neighbourhood<check_t> *,
+                                                    ScoreProfile *, size_t, size_t, size_t, size_t,
+                                                    bool, bool, bool);
+template void Phaser::UpdateShared<int16_t, false>(Neighbourhood<int16_t> *, Neighbourhood<check_t> *,
+                                                   ScoreProfile *, size_t, size_t, size_t, size_t);
+template void Phaser::UpdateShared<int16_t, true>(Neighbourhood<int16_t> *, Neighbourhood<check_t> *,
+                                                  ScoreProfile *, size_t, size_t, size_t, size_t);
+
 Phaser::~Phaser() {
   delete[] phase_string;
+  delete[] phase_margins;
+  for (size_t x = 0; x < 2; x++) {
+    delete[] M_code[x];
+    delete[] F_code[x];
+    delete[] C_code[x];
+    delete[] runs_M[x];
+    delete[] runs_F[x];
+  }
 }
 
 
@@ -493,7 +975,8 @@ void Phaser::PrintSequences() {
   return;
 }
 
-void Phaser::PrintFace(score_t ** face) {
+template<typename SCORE>
+void Phaser::PrintFace(Face<SCORE> * face) {
   const char separator    = ' ';
   const int width   = 5;
   if (verbose) {
@@ -509,7 +992,7 @@ void Phaser::PrintFace(score_t ** face) {
             for (size_t i = 0; i <= I_len; i++) {
               for (size_t j = 0; j <= J_len; j++) {
                 std::cout << std::left << std::setw(width) << std::setfill(separator) <<
-                    face[m][IJ(i, j)];
+                    face->Cell(IJ(i, j))[m];
               }
               std::cout << std::endl;
             }
@@ -521,7 +1004,7 @@ void Phaser::PrintFace(score_t ** face) {
   }
 }
 
-void Phaser::PrintCheck(my_pair ** check) {
+void Phaser::PrintCheck(Face<check_t> * check) {
   const char separator    = ' ';
   const int width   = 5;
   if (0) {
@@ -537,7 +1020,7 @@ void Phaser::PrintCheck(my_pair ** check) {
             for (size_t i = 0; i <= I_len; i++) {
               for (size_t j = 0; j <= J_len; j++) {
                 std::cout << std::left << std::setw(width) << std::setfill(separator) <<
-                    "(" << check[m][IJ(i, j)].first << "," << check[m][IJ(i, j)].second<< ")";
+                    "(" << CellI(check->Cell(IJ(i, j))[m]) << "," << CellJ(check->Cell(IJ(i, j))[m]) << ")";
               }
               std::cout << std::endl;
             }
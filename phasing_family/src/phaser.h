@@ -36,14 +36,87 @@ Inputs:
 #ifndef SRC_PHASER_H_
 #define SRC_PHASER_H_
 
+#include <cstdio>
 #include <cstdlib>
+#include <climits>
 #include <vector>
 #include <algorithm>
 #include <cassert>
 #include <utility>
 #include "./basic.h"
+#include "./alphabet.h"
+#include "./face.h"
+#include "./profile.h"
+#include "./scheme_profile.h"
+
+class BandFace;
+class ScoreLeft;
+
+// Checkpoints are the cell (i,j) of the mid plane through which the best
+// path goes, stored as its linear index IJ(i,j).
+typedef uint32_t check_t;
+
+// Backward score of the states that cannot reach the last cell, see
+// Phaser::BackwardPlane.
+const score_t BACKWARD_NONE = INT_MIN / 4;
+
+#ifdef __AVX2__
+const bool AVX2_AVAILABLE = true;
+#else
+const bool AVX2_AVAILABLE = false;
+#endif
+
+// Order in which partial_aligner sweeps each k-plane.
+enum sweep_t {
+  SWEEP_ROWS,       // j outer, i inner. One cell (8 states) at a time.
+  SWEEP_DIAGONALS,  // anti-diagonals i+j = d, vectorized across each diagonal.
+  SWEEP_DELTAS      // as SWEEP_ROWS, score planes stored as int8_t
+                    // differences; only for small scores (DeltasFit).
+};
+
+// Width of the scores stored in the DP faces of the row sweep. Only the
+// storage is narrowed; cells are still computed in score_t lanes.
+enum score_width_t {
+  WIDTH_AUTO,  // int16_t when the score bound of the sub-cube allows it.
+  WIDTH_16,    // int16_t. Only meant for testing, as it may saturate.
+  WIDTH_32     // score_t.
+};
+
+// Neighbours that a cell (i, j) of a k-plane has, k > 0.
+enum cell_kind_t {
+  CELL_CORNER,  // i == 0, j == 0: only back.
+  CELL_ROW_0,   // i > 0, j == 0: no down ones.
+  CELL_COL_0,   // i == 0, j > 0: no left ones.
+  CELL_INNER    // i > 0, j > 0: all of them.
+};
+
+// What the kernels do with the checkpoints of a k-plane.
+enum check_phase_t {
+  CHECKS_OFF,   // k < mid_k, or no checkpoints at all.
+  CHECKS_MID,   // k == mid_k: every cell is its own checkpoint.
+  CHECKS_COPY   // k > mid_k: copied from the chosen predecessor.
+};
+
+// Neighbours of a cell (i, j, k). The traceback engines code the
+// predecessor of a state as 8 * neighbour + state.
+enum neighbour_t {
+  N_BACK,       // (i,   j,   k-1)
+  N_LEFT,       // (i-1, j,   k)
+  N_BACK_LEFT,  // (i-1, j,   k-1)
+  N_DOWN,       // (i,   j-1, k)
+  N_BACK_DOWN,  // (i,   j-1, k-1)
+  N_BACK_DIAG,  // (i-1, j-1, k-1)
+  N_NEIGHBOURS
+};
 
-typedef std::pair<size_t, size_t> my_pair;
+// How aligner recovers the best path, see phaser_traceback.cpp.
+enum traceback_t {
+  TRACEBACK_AUTO,         // TRACEBACK_FULL if it fits in the memory budget.
+  TRACEBACK_CHECKPOINTS,  // recursion on the mid-plane checkpoints. Two planes.
+  TRACEBACK_FULL          // predecessor codes of the whole sub-cube, one sweep.
+                          // May pick another co-optimal phasing than the
+                          // recursion.
+};
 
 class Phaser {
  protected:
@@ -58,6 +131,13 @@ class Phaser {
   size_t C_len;
 
   char * phase_string;
+  // Set by similarity_and_consensus, NULL before.
+  score_t * phase_margins;
+
+  // Encoded copies of the sequences, [0] for *1 and [1] for *2.
+  code_t * M_code[2];
+  code_t * F_code[2];
+  code_t * C_code[2];
 
   // local variables
   size_t I_len;
@@ -66,7 +146,41 @@ class Phaser {
   score_t SCORE_GAP;
   score_t SCORE_MISMATCH;
   score_t SCORE_MATCH;
+  // Score of each pair_t.
+  score_t pair_scores[N_PAIR_KINDS];
   bool verbose;
+  bool use_avx2;
+  bool shared_reductions;
+  sweep_t sweep;
+  score_width_t score_width;
+  // Initial width of the banded sweep, 0 if disabled.
+  size_t band;
+  // Tries SweepWavefront before the other sweeps.
+  bool wavefront;
+  // SweepWavefront bounds the score left with ProjectionBound.
+  bool projection_bounds;
+  // Set by the kernels when a score does not fit in the face type.
+  bool saturated;
+  traceback_t traceback;
+  // Bytes that TRACEBACK_AUTO may spend on a sub-cube.
+  size_t memory_budget;
+  // aligner runs SmallAligner on the sub-cubes of at most small_planes planes.
+  size_t small_planes;
+  // The runs of gaps in both haplotypes of M or F are collapsed to one column
+  // before the first sweep (CollapseGapRuns). The collapsed copies of the
+  // parents, NULL if nothing was collapsed, and the original column of each
+  // collapsed one.
+  bool gap_runs;
+  bool runs_collapsed;
+  char * runs_M[2];
+  char * runs_F[2];
+  std::vector<size_t> m_columns;
+  std::vector<size_t> f_columns;
+  // UpdateFixed only computes the states of one haplotype of the members
+  // that are homozygous at the cell.
+  bool collapse_homozygous;
+  // Bytes that similarity_and_consensus_schemes may spend on lanes.
+  size_t scheme_budget;
 
  public:
   // constructor receive the input data.
@@ -80,13 +194,29 @@ class Phaser {
          char * _C2,
          size_t _C_len);
 
-  // Only computes similarity distance.
+  // Only computes similarity distance: one sweep, no checkpoints.
   score_t similarity();
 
   // Computes similarity distance, and
-  // build the phase_string using the checkpoint method.
+  // build the phase_string using the checkpoint method, or the traceback
+  // engine of SetTraceback.
   score_t similarity_and_phase();
 
+  // Computes similarity distance, and the phase of each symbol of C on
+  // which all the co-optimal alignments agree, '?' on the others, in one
+  // pass, and how far from the optimum is each symbol phased the other
+  // way (GetPhaseMargins). See phaser_consensus.cpp.
+  score_t similarity_and_consensus();
+
+  // similarity_and_consensus under each of n_schemes scoring schemes,
+  // SCHEME_LANES of them per sweep: scores[s], and the phase in phases[s]
+  // (C_len chars, given by the caller). See phaser_schemes.cpp and
+  // SetSchemeBudget.
+  void similarity_and_consensus_schemes(const ScoringScheme * schemes,
+                                        size_t n_schemes,
+                                        score_t * scores,
+                                        char ** phases);
+
   // compute through partial_aligner and calls itself recursively.
   score_t aligner(size_t i_ini,
                   size_t j_ini,
@@ -107,62 +237,453 @@ class Phaser {
                           size_t *k_med);
   // Auxiliar functions:
 
-  void UpdateGeneral(score_t ** curr_face,
-                     score_t ** prev_face,
-                     my_pair ** curr_check,
-                     my_pair ** prev_check,
+  // See phaser_gap_runs.cpp.
+  void CollapseGapRuns();
+  // Keeps the first column of each run of gaps in both *P1 and *P2, in new
+  // copies own[0] and own[1]. columns gets the original column of each kept
+  // one, unless all of them are kept.
+  void CollapseRuns(char ** P1,
+                    char ** P2,
+                    size_t * P_len,
+                    code_t ** P_code,
+                    char ** own,
+                    std::vector<size_t> * columns);
+
+  // Engine that aligner runs on a sub-cube of K_len planes.
+  traceback_t PickTraceback(size_t K_len);
+
+  // Bytes that engine needs on a sub-cube of K_len planes.
+  size_t TracebackBytes(traceback_t engine, size_t K_len);
+
+  // aligner with TRACEBACK_FULL: one sweep of the sub-cube, then the phase
+  // of every plane from the best path. Reruns with score_t faces if the
+  // narrow ones saturate.
+  score_t TraceAligner(size_t i_ini,
+                       size_t j_ini,
+                       size_t k_ini,
+                       size_t K_len);
+
+  // Set saturated if a score does not fit in SCORE.
+  template<typename SCORE>
+  score_t FullTraceback(size_t i_ini,
+                        size_t j_ini,
+                        size_t k_ini,
+                        size_t K_len);
+
+  // Same, on the given face, profile and 8 * (I_len+1) * (J_len+1) * K_len
+  // codes.
+  template<typename SCORE>
+  score_t FullTraceback(size_t i_ini,
+                        size_t j_ini,
+                        size_t k_ini,
+                        size_t K_len,
+                        RollingFace<SCORE> * face,
+                        ScoreProfile * profile,
+                        uint8_t * codes);
+
+  // The sub-cube of K_len planes fits the buffer of SmallAligner.
+  bool SmallFits(size_t K_len);
+
+  // aligner on sub-cubes that SmallFits, see phaser_small.cpp.
+  score_t SmallAligner(size_t i_ini,
+                       size_t j_ini,
+                       size_t k_ini,
+                       size_t K_len);
+
+  // TRACEBACK_FULL with its planes, profile and codes carved from arena.
+  template<typename SCORE>
+  score_t SmallTraceback(size_t i_ini,
+                         size_t j_ini,
+                         size_t k_ini,
+                         size_t K_len,
+                         unsigned char * arena);
+
+  // Computes the plane k over face and, unless codes is NULL, writes the
+  // predecessor code of each state, codes[8 * IJ(i, j) + m].
+  template<typename SCORE>
+  void CodePlane(RollingFace<SCORE> * face,
+                 ScoreProfile * profile,
+                 size_t k,
+                 uint8_t * codes);
+
+  // Follows the codes of the planes k_lo+1..k_hi back from the state *m of
+  // the cell (*i, *j) of the plane k_hi, down to the plane k_lo. Writes the
+  // phase of the symbols k_ini+k_lo..k_ini+k_hi-1 of C.
+  void TraceCodes(const uint8_t * codes,
+                  size_t k_lo,
+                  size_t k_hi,
+                  size_t k_ini,
+                  size_t * i,
+                  size_t * j,
+                  size_t * m);
+
+  // Best score from each state of a plane k to the last cell, given the ones
+  // of the plane k+1 (next, NULL for k = K_len) and its profile terms.
+  void BackwardPlane(score_t * curr, const score_t * next, ScoreProfile * profile);
+
+#ifdef __AVX2__
+  // Same as BackwardPlane, one vector per cell, see phaser_avx2.cpp.
+  void BackwardPlaneAVX2(score_t * curr, const score_t * next, ScoreProfile * profile);
+#endif
+
+  // Best score of the paths that phase C[k] as cf, best[2*k + cf], from a
+  // forward and a backward sweep of the whole cube. Returns the best score.
+  score_t PhaseMarginals(score_t * best);
+
+  // PhaseMarginals under the SCHEME_LANES schemes of lanes, one per lane:
+  // best[2*k + cf] and the best score ans. See phaser_schemes.cpp.
+  void SchemeMarginals(const ScoringScheme * lanes, SchemeLanes * best, SchemeLanes * ans);
+  // Bytes of the planes and profile of SchemeMarginals.
+  size_t SchemeBytes();
+  void InitSchemeProfile(const ScoringScheme * lanes, SchemeProfile * profile);
+  void FillSchemeProfile(const ScoringScheme * lanes, SchemeProfile * profile, size_t k);
+  void SchemeFirstPlane(SchemeLanes * plane, SchemeProfile * profile);
+  void SchemeForwardPlane(SchemeLanes * curr, const SchemeLanes * prev, SchemeProfile * profile);
+  void SchemeBackwardPlane(SchemeLanes * curr, const SchemeLanes * next, SchemeProfile * profile);
+
+  // Runs one of the sweeps below, rerunning with score_t faces if
+  // the narrow ones saturate.
+  void Sweep(size_t i_ini,
+             size_t j_ini,
+             size_t k_ini,
+             size_t K_len,
+             size_t mid_k,
+             score_t * last_scores,
+             check_t * last_checks);
+
+  // Plane sweeps used by partial_aligner. They compute the K_len planes
+  // of the current sub-cube and return the 8 states of its last cell.
+  // With last_checks NULL only the scores are computed.
+  // SCORE is the type stored in the faces, see score_width_t.
+  template<typename SCORE>
+  void SweepRows(size_t i_ini,
+                 size_t j_ini,
+                 size_t k_ini,
+                 size_t K_len,
+                 size_t mid_k,
+                 score_t * last_scores,
+                 check_t * last_checks);
+
+  // Planes are kept as differences along i, see phaser_deltas.cpp.
+  // Sets saturated if a difference does not fit in int8_t.
+  void SweepDeltas(size_t i_ini,
+                   size_t j_ini,
+                   size_t k_ini,
+                   size_t K_len,
+                   size_t mid_k,
+                   score_t * last_scores,
+                   check_t * last_checks);
+
+#ifdef __AVX2__
+  void SweepDiagonals(size_t i_ini,
+                      size_t j_ini,
+                      size_t k_ini,
+                      size_t K_len,
+                      size_t mid_k,
+                      score_t * last_scores,
+                      check_t * last_checks);
+#endif
+
+  // Banded sweep of width SetBand, doubled while the best path touches the
+  // edge of the band, see phaser_band.cpp. Returns false when banding is
+  // off or the band would cover the whole sub-cube; the caller then runs
+  // Sweep. last_i and last_j are the checkpoints of the 8 states.
+  bool SweepBanded(size_t i_ini,
+                   size_t j_ini,
+                   size_t k_ini,
+                   size_t K_len,
+                   size_t mid_k,
+                   score_t * last_scores,
+                   size_t * last_i,
+                   size_t * last_j);
+
+  // One banded run. Returns false if the best path touched the band edge.
+  bool SweepBand(size_t i_ini,
+                 size_t j_ini,
+                 size_t k_ini,
+                 size_t K_len,
+                 size_t mid_k,
+                 size_t width,
+                 score_t * last_scores,
+                 size_t * last_i,
+                 size_t * last_j);
+
+  // Scores of the box of curr_face in the plane k, from prev_face.
+  // Checkpoints of the mid plane are indices in its box.
+  void BandPlane(BandFace * curr_face,
+                 BandFace * prev_face,
+                 ScoreProfile * profile,
+                 size_t i_ini,
+                 size_t j_ini,
+                 size_t k_ini,
+                 size_t k,
+                 size_t mid_k);
+
+  // Sweep that only follows the paths that stay close to the best one, see
+  // phaser_wavefront.cpp. Its cost grows with the number of edits of the
+  // best path, not with the size of the sub-cube. Returns false when it is
+  // off, or when the cells it would need are a large part of the planes; the
+  // caller then runs SweepBanded or Sweep.
+  bool SweepWavefront(size_t i_ini,
+                      size_t j_ini,
+                      size_t k_ini,
+                      size_t K_len,
+                      size_t mid_k,
+                      score_t * last_scores,
+                      size_t * last_i,
+                      size_t * last_j);
+
+  // One run keeping the cells where twice the score of some state plus
+  // left->Twice(i, j, k) is at least min_score. Returns false if the last
+  // cell is not among them, and sets too_wide if they are too many.
+  bool SweepPruned(size_t i_ini,
+                   size_t j_ini,
+                   size_t k_ini,
+                   size_t K_len,
+                   size_t mid_k,
+                   ScoreLeft * left,
+                   score_t min_score,
+                   score_t * last_scores,
+                   size_t * last_i,
+                   size_t * last_j,
+                   bool * too_wide);
+
+  // Upper bound of the score of the paths from (p, k) to (P_len, K_len) in
+  // the alignment of C against one parent, for every p and k. Each
+  // step picks the best haplotypes of both, so it bounds the part of the
+  // score of any path of the cube that the parent takes. bound[k*(P_len+1)+p].
+  void ProjectionBound(code_t * const * P_code,
+                       char * P1,
+                       char * P2,
+                       size_t p_ini,
+                       size_t P_len,
+                       size_t k_ini,
+                       size_t K_len,
+                       std::vector<score_t> * bound);
+
+  // Profile terms of the sub-cube starting at (i_ini, j_ini):
+  // InitProfile writes the ones that are the same in every plane,
+  // FillProfile the ones of the plane k (global index).
+  void InitProfile(ScoreProfile * profile, size_t i_ini, size_t j_ini);
+  void FillProfile(ScoreProfile * profile,
+                   size_t i_ini,
+                   size_t j_ini,
+                   size_t k);
+  // Only the entries i_lo..i_hi and j_lo..j_hi.
+  void FillProfile(ScoreProfile * profile,
+                   size_t i_ini,
+                   size_t j_ini,
+                   size_t k,
+                   size_t i_lo,
+                   size_t i_hi,
+                   size_t j_lo,
+                   size_t j_hi);
+
+  // Checkpoints are only read and written when TRACK is set.
+  template<typename SCORE, bool TRACK>
+  void UpdateGeneral(Neighbourhood<SCORE> * scores,
+                     Neighbourhood<check_t> * checks,
+                     ScoreProfile * profile,
                      size_t i,
                      size_t j,
                      size_t k,
                      size_t mid_k,
                      bool mf,
                      bool ff,
-                     bool cf,
-                     char m_char,
-                     char f_char,
-                     char c_1,
-                     char c_2);
+                     bool cf);
+
+  // Same as UpdateGeneral, for the 8 states of the cell at once. The best
+  // predecessor of each group of states is found once per cell. Picks the
+  // UpdateFixed that fits the cell.
+  template<typename SCORE, bool TRACK>
+  void UpdateShared(Neighbourhood<SCORE> * scores,
+                    Neighbourhood<check_t> * checks,
+                    ScoreProfile * profile,
+                    size_t i,
+                    size_t j,
+                    size_t k,
+                    size_t mid_k);
+
+  template<typename SCORE, check_phase_t PHASE>
+  void UpdateShared(Neighbourhood<SCORE> * scores,
+                    Neighbourhood<check_t> * checks,
+                    ScoreProfile * profile,
+                    size_t i,
+                    size_t j);
+
+  // UpdateShared with the boundary and checkpoint tests, and the state
+  // bits, known at compile time. The states with a bit of SKIP are copies
+  // of the ones without it, see SetCollapseHomozygous.
+  template<typename SCORE, check_phase_t PHASE, cell_kind_t CELL, size_t SKIP = 0>
+  void UpdateFixed(Neighbourhood<SCORE> * scores,
+                   Neighbourhood<check_t> * checks,
+                   ScoreProfile * profile,
+                   size_t i,
+                   size_t j);
+
+  // UpdateFixed of an inner cell, with SKIP given at run time.
+  template<typename SCORE, check_phase_t PHASE>
+  void UpdateInner(Neighbourhood<SCORE> * scores,
+                   Neighbourhood<check_t> * checks,
+                   ScoreProfile * profile,
+                   size_t i,
+                   size_t j,
+                   size_t skip);
+
+  // The state bits that UpdateFixed copies in the cell (i, j): 1 if
+  // M1[i] == M2[i], 2 if F1[j] == F2[j], 4 if C1[k] == C2[k] in the plane of
+  // the profile.
+  inline size_t Skip(ScoreProfile * profile, size_t i, size_t j) {
+    if (!collapse_homozygous) {
+      return 0;
+    }
+    return (profile->m_same[i] ? 1 : 0) | (profile->f_same[j] ? 2 : 0) | (profile->c_same ? 4 : 0);
+  }
+
+  template<typename SCORE>
+  void FirstPlane(RollingFace<SCORE> * face,
+                  RollingFace<check_t> * check,
+                  ScoreProfile * profile);
+
+  // One plane k > 0 of SweepRows with UpdateFixed: the first row and
+  // column are peeled, so the inner loop has no boundary tests.
+  template<typename SCORE, check_phase_t PHASE>
+  void SweepPlane(RollingFace<SCORE> * face,
+                  RollingFace<check_t> * check,
+                  ScoreProfile * profile);
+
+#ifdef __AVX2__
+  // Same as UpdateGeneral, for the 8 states of the cell at once. With CODES
+  // the planes k > mid_k get the predecessor codes of the traceback engines
+  // instead of checkpoints, and the checkpoints of the neighbours are not read.
+  template<typename SCORE, bool TRACK, bool CODES>
+  void UpdateCellAVX2(Neighbourhood<SCORE> * scores,
+                      Neighbourhood<check_t> * checks,
+                      ScoreProfile * profile,
+                      size_t i,
+                      size_t j,
+                      size_t k,
+                      size_t mid_k);
+#endif
+
+  // The 8 states of the cell (i, j, k), with the kernel chosen by SetAVX2
+  // and SetSharedReductions.
+  template<typename SCORE, bool TRACK>
+  inline void UpdateCell(Neighbourhood<SCORE> * scores,
+                         Neighbourhood<check_t> * checks,
+                         ScoreProfile * profile,
+                         size_t i,
+                         size_t j,
+                         size_t k,
+                         size_t mid_k) {
+#ifdef __AVX2__
+    if (use_avx2) {
+      UpdateCellAVX2<SCORE, TRACK, false>(scores, checks, profile, i, j, k, mid_k);
+      return;
+    }
+#endif
+    if (shared_reductions) {
+      UpdateShared<SCORE, TRACK>(scores, checks, profile, i, j, k, mid_k);
+      return;
+    }
+    for (bool cf : {false, true}) {
+      for (bool ff : {false, true}) {
+        for (bool mf : {false, true}) {
+          UpdateGeneral<SCORE, TRACK>(scores, checks, profile, i, j, k, mid_k, mf, ff, cf);
+        }
+      }
+    }
+  }
 
   // Inline methods :
-  inline void ExtractMax(score_t ** prev_face,
-                         my_pair ** prev_check,
+  inline void ExtractMax(score_t * last_face,
+                         size_t * last_i,
+                         size_t * last_j,
                          score_t * ans,
                          size_t* i_med,
                          size_t* j_med,
                          bool * flip) {
-    *ans = prev_face[0][IJ(I_len, J_len)];
-    *i_med = ((prev_check[0][IJ(I_len, J_len)]).first);
-    *j_med = ((prev_check[0][IJ(I_len, J_len)]).second);
-    *flip = 0;
+    size_t best = BestState(last_face);
+    *ans = last_face[best];
+    *i_med = last_i[best];
+    *j_med = last_j[best];
+    *flip = (best >= 4);
+  }
+
+  // First state of the last cell with the maximum score.
+  inline size_t BestState(score_t * last_face) {
+    size_t best = 0;
     for (bool cf : {false, true}) {
       for (bool ff : {false, true}) {
         for (bool mf : {false, true}) {
           size_t m = m_index(mf, ff, cf);
-          if (prev_face[m][IJ(I_len, J_len)] > (*ans)) {
-            *ans = prev_face[m][IJ(I_len, J_len)];
-            *i_med = ((prev_check[m][IJ(I_len, J_len)]).first);
-            *j_med = ((prev_check[m][IJ(I_len, J_len)]).second);
-            *flip = cf;
+          if (last_face[m] > last_face[best]) {
+            best = m;
           }
         }
       }
     }
+    return best;
   }
 
   inline void UpdateVals(score_t candidate,
-                        my_pair check,
+                        check_t check,
                         score_t * max,
-                        my_pair * real_check) {
+                        check_t * real_check) {
     if (candidate > *max) {
       *max = candidate;
       *real_check = check;
     }
   }
 
+  // Phase of a symbol of C, given the best scores of the paths that phase
+  // it as 0 and as 1, see phaser_consensus.cpp.
+  inline char ConsensusPhase(score_t best_0, score_t best_1, score_t ans) {
+    assert(best_0 == ans || best_1 == ans);
+    return (best_0 == best_1) ? '?' : ((best_0 == ans) ? '0' : '1');
+  }
+
   inline char * GetPhaseString() {
     return phase_string;
   }
 
+  // margins[k]: the score lost by the best alignment that phases C[k] the
+  // other way, 0 on the '?' of similarity_and_consensus.
+  inline score_t * GetPhaseMargins() {
+    return phase_margins;
+  }
+
+  // Column of the M (F) given to the constructor for the column i (j) of
+  // the sub-cubes, see SetGapRuns.
+  inline size_t OriginalM(size_t i) {
+    return m_columns.empty() ? i : m_columns[i];
+  }
+  inline size_t OriginalF(size_t j) {
+    return f_columns.empty() ? j : f_columns[j];
+  }
+
+  // Every transition adds at most two scores, so no value of a sub-cube
+  // is larger (in absolute value) than this bound.
+  inline size_t ScoreBound(size_t K_len) {
+    size_t max_abs = (size_t)std::max(std::abs(SCORE_MATCH),
+                                      std::max(std::abs(SCORE_GAP), std::abs(SCORE_MISMATCH)));
+    return 2 * max_abs * (I_len + J_len + K_len);
+  }
+
+  // A single transition moves a score by up to 2*max|score|. When that
+  // does not fit in the int8_t differences of SweepDeltas, nearly every
+  // row saturates, so the engine is not even tried.
+  inline bool DeltasFit() {
+    size_t max_abs = (size_t)std::max(std::abs(SCORE_MATCH),
+                                      std::max(std::abs(SCORE_GAP), std::abs(SCORE_MISMATCH)));
+    return 2 * max_abs <= (size_t)INT8_MAX;
+  }
+
+  // SweepDiagonals keeps checkpoints as 32 bits cell ids.
+  inline bool DiagonalsFit() {
+    return (I_len+1) * (J_len+1) < (size_t)INT_MAX;
+  }
+
   inline bool CorrectIniMedEnd(size_t ini, size_t med, size_t end) {
     if (!(med <= end || med+1 <= end))
         return false;
@@ -183,15 +704,55 @@ class Phaser {
   }
 
 
-  inline score_t score(char a, char b) {
-    if ((a == '-') && (b == '-'))
-      return 0;
-    if (a == b)
-      return SCORE_MATCH;
-    if ((a == '-') || (b == '-'))
-      return SCORE_GAP;
-    else
-      return SCORE_MISMATCH;
+  // Score of two encoded symbols, at least one of them not CODE_OTHER.
+  inline score_t score(code_t a, code_t b) {
+    assert(a < ALPHABET_SIZE && b < ALPHABET_SIZE);
+    assert(PAIR_KINDS[(a << 3) | b] != PAIR_OTHERS);
+    return pair_scores[PAIR_KINDS[(a << 3) | b]];
+  }
+
+  // Score of any two symbols, given also as chars.
+  inline score_t score(code_t a, code_t b, char a_char, char b_char) {
+    assert(a < ALPHABET_SIZE && b < ALPHABET_SIZE);
+    pair_t kind = PAIR_KINDS[(a << 3) | b];
+    if (kind == PAIR_OTHERS) {
+      return (a_char == b_char) ? SCORE_MATCH : SCORE_MISMATCH;
+    }
+    return pair_scores[kind];
+  }
+
+  // Both symbols score the same against any other.
+  inline bool SameSymbol(code_t a, code_t b, char a_char, char b_char) {
+    return a == b && (a != CODE_OTHER || a_char == b_char);
+  }
+
+  // Blocks of the cell (i,j) and its neighbours, in the planes k (curr)
+  // and k-1 (prev).
+  template<typename TYPE>
+  inline void Neighbours(Face<TYPE> * curr,
+                         Face<TYPE> * prev,
+                         size_t i,
+                         size_t j,
+                         Neighbourhood<TYPE> * ans) {
+    ans->curr = curr->Cell(IJ(i, j));
+    ans->back = prev->Cell(IJ(i, j));
+    ans->left = (i > 0) ? curr->Cell(IJ(i-1, j)) : NULL;
+    ans->back_left = (i > 0) ? prev->Cell(IJ(i-1, j)) : NULL;
+    ans->down = (j > 0) ? curr->Cell(IJ(i, j-1)) : NULL;
+    ans->back_down = (j > 0) ? prev->Cell(IJ(i, j-1)) : NULL;
+    ans->back_diag = (i > 0 && j > 0) ? prev->Cell(IJ(i-1, j-1)) : NULL;
+  }
+
+  inline check_t CellId(size_t i, size_t j) {
+    return (check_t)IJ(i, j);
+  }
+
+  inline size_t CellI(check_t id) {
+    return id % (I_len+1);
+  }
+
+  inline size_t CellJ(check_t id) {
+    return id / (I_len+1);
   }
 
   inline size_t IJ(size_t x, size_t y) {
@@ -205,20 +766,106 @@ class Phaser {
   inline void SetScoreGap(score_t val) {
     assert(val < 0);
     SCORE_GAP = val;
+    pair_scores[PAIR_GAP] = val;
   }
   inline void SetScoreMismatch(score_t val) {
     assert(val < 0);
     SCORE_MISMATCH = val;
+    pair_scores[PAIR_MISMATCH] = val;
   }
   inline void SetScoreMatch(score_t val) {
     assert(val > 0);
     SCORE_MATCH = val;
+    pair_scores[PAIR_MATCH] = val;
+  }
+  // The scalar UpdateGeneral is the reference kernel, the AVX2 one
+  // is used by default when the code is compiled with AVX2 support.
+  inline void SetAVX2(bool val) {
+    use_avx2 = val && AVX2_AVAILABLE;
+  }
+  // Without AVX2, UpdateShared is used unless this is off; UpdateGeneral
+  // then runs once per state.
+  inline void SetSharedReductions(bool val) {
+    shared_reductions = val;
+  }
+  // SWEEP_DIAGONALS needs the AVX2 kernels, otherwise rows are used
+  // (and said so on stderr, once).
+  inline void SetSweep(sweep_t val) {
+    static bool reported = false;
+    if (val == SWEEP_DIAGONALS && !AVX2_AVAILABLE && !reported) {
+      fprintf(stderr, "SWEEP_DIAGONALS needs a build with ARCH=-mavx2, rows are used.\n");
+      reported = true;
+    }
+    sweep = val;
+  }
+  // Engine of similarity_and_phase, see traceback_t.
+  inline void SetTraceback(traceback_t val) {
+    traceback = val;
+  }
+  // Bytes a traceback engine may use on a sub-cube, see TracebackBytes.
+  // With TRACEBACK_AUTO, the larger sub-cubes are split by the checkpoint
+  // recursion until they fit. 0 by default, so the phasing of a Phaser does
+  // not depend on the sizes of its inputs; the binaries pass 64 MB.
+  inline void SetMemoryBudget(size_t val) {
+    memory_budget = val;
+  }
+  // aligner solves the sub-cubes of at most val planes that fit a fixed
+  // buffer on the stack with TRACEBACK_FULL, instead of recursing. With 1,
+  // only the leaves of the recursion, and the phasing does not change.
+  // Larger values cut the tail of the recursion, but like TRACEBACK_FULL
+  // may pick another of the co-optimal phasings. 0 disables it.
+  inline void SetSmallPlanes(size_t val) {
+    small_planes = val;
+  }
+  // Collapses each run of columns with a gap in both haplotypes of a parent
+  // to its first column, which gives the same scores and phasing. Read by
+  // the first similarity or similarity_and_phase.
+  inline void SetGapRuns(bool val) {
+    gap_runs = val;
+  }
+  // The scalar kernels compute only half of the states for each member of
+  // the trio that is homozygous at the cell, and copy the others: same
+  // scores, checkpoints and phasing. The AVX2 kernels compute the 8 states
+  // at once, and do not look at it.
+  inline void SetCollapseHomozygous(bool val) {
+    collapse_homozygous = val;
+  }
+  // similarity_and_consensus_schemes keeps SCHEME_LANES scores per state:
+  // when its planes (SchemeBytes) do not fit in val bytes, the schemes run
+  // one at a time instead, on the planes of similarity_and_consensus.
+  inline void SetSchemeBudget(size_t val) {
+    scheme_budget = val;
+  }
+  // Narrow sweeps that saturate are transparently rerun with score_t.
+  inline void SetScoreWidth(score_width_t val) {
+    score_width = val;
+  }
+
+  // Only evaluates the cells with |i*K/I - k| and |j*K/J - k| at most
+  // val. The band is widened while the best path touches its edge.
+  // 0 disables it.
+  inline void SetBand(size_t val) {
+    band = val;
+  }
+
+  // Starts with SweepWavefront, which pays off when the trio is close to
+  // the maximum score. Falls back to the other sweeps otherwise.
+  inline void SetWavefront(bool val) {
+    wavefront = val;
+  }
+
+  // A*-like pruning: SweepWavefront drops the cells that cannot reach the
+  // best score, bounding what is left of a path with alignments of C against
+  // each parent. Also turns SweepWavefront on.
+  inline void SetProjectionBounds(bool val) {
+    projection_bounds = val;
   }
 
   // Debug:
   void PrintSequences();
-  void PrintFace(score_t ** face);
-  void PrintCheck(my_pair ** check);
+  template<typename SCORE>
+  void PrintFace(Face<SCORE> * face);
+  void PrintCheck(Face<check_t> * check);
   void PrintPhaseString();
 
 
@@ -0,0 +1,334 @@
+/* Copyright (C) 2013, Daniel Valenzuela, all rights reserved.
+ * dvalenzu@cs.helsinki.fi
+ */
+
+// AVX2 version of Phaser::UpdateGeneral.
+// The 8 states of a cell fit in one vector of 8 int32 lanes, lane m holding
+// state m = m_index(mf, ff, cf). The predecessors that UpdateGeneral selects
+// with m_index(pre_mf, ff, pre_cf) and friends become lane permutations, and
+// the chains of UpdateVals become vector max/blend with the same "first
+// maximum wins" rule, so scores and checkpoints are bit-identical to the
+// scalar kernel.
+//
+// BackwardPlaneAVX2, at the end, does the same for BackwardPlane.
+//
+// Faces of int16_t scores (WIDTH_16 and WIDTH_AUTO) are widened to the same
+// 8 int32 lanes on load and narrowed on store: they halve the face memory,
+// not the work per cell. Filling 16 int16 lanes would take two cells per
+// vector, and the cells of a row depend on each other.
+
+#include "./phaser.h"
+#include <cassert>
+#include "./simd.h"
+
+#ifdef __AVX2__
+
+// The source of a checkpoint is encoded as 8*neighbour + state, with the
+// neighbours numbered as in neighbour_t.
+
+// All-ones in the lanes m = m_index(mf, ff, cf) whose mf and ff flags are set.
+static inline __m256i LaneMask(bool mf_0, bool mf_1, bool ff_0, bool ff_1) {
+  return Lanes(-mf_0 & -ff_0, -mf_1 & -ff_0, -mf_0 & -ff_1, -mf_1 & -ff_1,
+               -mf_0 & -ff_0, -mf_1 & -ff_0, -mf_0 & -ff_1, -mf_1 & -ff_1);
+}
+
+template<typename SCORE, bool TRACK, bool CODES>
+void Phaser::UpdateCellAVX2(Neighbourhood<SCORE> * scores,
+                            Neighbourhood<check_t> * checks,
+                            ScoreProfile * profile,
+                            size_t i,
+                            size_t j,
+                            size_t k,
+                            size_t mid_k) {
+  // Predecessor lanes, as in UpdateGeneral.
+  // e.g. SAME_MF_FF_CF0[m] = m_index(mf, ff, 0).
+  const __m256i SAME_MF_FF_CF0 = Lanes(0, 1, 2, 3, 0, 1, 2, 3);
+  const __m256i SAME_MF_FF_CF1 = Lanes(4, 5, 6, 7, 4, 5, 6, 7);
+  const __m256i SAME_FF_CF_MF0 = Lanes(0, 0, 2, 2, 4, 4, 6, 6);
+  const __m256i SAME_FF_CF_MF1 = Lanes(1, 1, 3, 3, 5, 5, 7, 7);
+  const __m256i SAME_MF_CF_FF0 = Lanes(0, 1, 0, 1, 4, 5, 4, 5);
+  const __m256i SAME_MF_CF_FF1 = Lanes(2, 3, 2, 3, 6, 7, 6, 7);
+  const __m256i SAME_FF[4] = {Lanes(0, 0, 2, 2, 0, 0, 2, 2),   // pre_cf = 0, pre_mf = 0
+                              Lanes(1, 1, 3, 3, 1, 1, 3, 3),   // pre_cf = 0, pre_mf = 1
+                              Lanes(4, 4, 6, 6, 4, 4, 6, 6),   // pre_cf = 1, pre_mf = 0
+                              Lanes(5, 5, 7, 7, 5, 5, 7, 7)};  // pre_cf = 1, pre_mf = 1
+  const __m256i SAME_MF[4] = {Lanes(0, 1, 0, 1, 0, 1, 0, 1),   // pre_cf = 0, pre_ff = 0
+                              Lanes(2, 3, 2, 3, 2, 3, 2, 3),   // pre_cf = 0, pre_ff = 1
+                              Lanes(4, 5, 4, 5, 4, 5, 4, 5),   // pre_cf = 1, pre_ff = 0
+                              Lanes(6, 7, 6, 7, 6, 7, 6, 7)};  // pre_cf = 1, pre_ff = 1
+
+  check_t * src_checks[N_NEIGHBOURS] = {NULL, NULL, NULL, NULL, NULL, NULL};
+
+  // only k decreases. Two deletions from C.
+  __m256i back = LoadScores(scores->back);
+  src_checks[N_BACK] = checks->back;
+  __m256i c_del = _mm256_set1_epi32(profile->c_del);
+  __m256i max_score = _mm256_add_epi32(_mm256_permutevar8x32_epi32(back, SAME_MF_FF_CF0), c_del);
+  __m256i max_src = SAME_MF_FF_CF0;
+  UpdateValsAVX2(_mm256_add_epi32(_mm256_permutevar8x32_epi32(back, SAME_MF_FF_CF1), c_del),
+                 SAME_MF_FF_CF1, &max_score, &max_src);
+
+  // Lanes whose parent character is a gap just copy the best neighbour.
+  __m256i gap_mask = _mm256_setzero_si256();
+  __m256i gap_score = _mm256_setzero_si256();
+  __m256i gap_src = _mm256_setzero_si256();
+
+  score_t m_align[2][2] = {{0, 0}, {0, 0}};  // [cf][mf]: score(c_1, m_char)
+  if (i > 0) {
+    for (int cf = 0; cf < 2; cf++) {
+      for (int mf = 0; mf < 2; mf++) {
+        m_align[cf][mf] = profile->m_align[cf][mf][i];
+      }
+    }
+    __m256i left = LoadScores(scores->left);
+    src_checks[N_LEFT] = checks->left;
+    __m256i p1 = _mm256_permutevar8x32_epi32(left, SAME_FF_CF_MF0);
+    __m256i p2 = _mm256_permutevar8x32_epi32(left, SAME_FF_CF_MF1);
+    __m256i p1_src = _mm256_add_epi32(SAME_FF_CF_MF0, _mm256_set1_epi32(8*N_LEFT));
+    __m256i p2_src = _mm256_add_epi32(SAME_FF_CF_MF1, _mm256_set1_epi32(8*N_LEFT));
+
+    gap_mask = LaneMask(profile->m_gap[0][i] != 0, profile->m_gap[1][i] != 0, true, true);
+    gap_score = _mm256_max_epi32(p1, p2);
+    gap_src = _mm256_blendv_epi8(p2_src, p1_src, _mm256_cmpgt_epi32(p1, p2));
+
+    // only i decreases. Single deletion from M.
+    score_t ins_1 = profile->m_ins[0][i];
+    score_t ins_2 = profile->m_ins[1][i];
+    __m256i m_ins = Lanes(ins_1, ins_2, ins_1, ins_2, ins_1, ins_2, ins_1, ins_2);
+    UpdateValsAVX2(_mm256_add_epi32(p1, m_ins), p1_src, &max_score, &max_src);
+    UpdateValsAVX2(_mm256_add_epi32(p2, m_ins), p2_src, &max_score, &max_src);
+
+    // k and i decreases: single deletions from C, M aligns.
+    score_t del_0 = profile->m_del[0];
+    score_t del_1 = profile->m_del[1];
+    __m256i m_del = Lanes(m_align[0][0] + del_0, m_align[0][1] + del_0,
+                          m_align[0][0] + del_0, m_align[0][1] + del_0,
+                          m_align[1][0] + del_1, m_align[1][1] + del_1,
+                          m_align[1][0] + del_1, m_align[1][1] + del_1);
+    __m256i back_left = LoadScores(scores->back_left);
+    src_checks[N_BACK_LEFT] = checks->back_left;
+    for (int pre = 0; pre < 4; pre++) {
+      UpdateValsAVX2(_mm256_add_epi32(_mm256_permutevar8x32_epi32(back_left, SAME_FF[pre]), m_del),
+                     _mm256_add_epi32(SAME_FF[pre], _mm256_set1_epi32(8*N_BACK_LEFT)),
+                     &max_score, &max_src);
+    }
+  }
+
+  score_t f_align[2][2] = {{0, 0}, {0, 0}};  // [cf][ff]: score(c_2, f_char)
+  if (j > 0) {
+    for (int cf = 0; cf < 2; cf++) {
+      for (int ff = 0; ff < 2; ff++) {
+        f_align[cf][ff] = profile->f_align[cf][ff][j];
+      }
+    }
+    __m256i down = LoadScores(scores->down);
+    src_checks[N_DOWN] = checks->down;
+    __m256i p1 = _mm256_permutevar8x32_epi32(down, SAME_MF_CF_FF0);
+    __m256i p2 = _mm256_permutevar8x32_epi32(down, SAME_MF_CF_FF1);
+    __m256i p1_src = _mm256_add_epi32(SAME_MF_CF_FF0, _mm256_set1_epi32(8*N_DOWN));
+    __m256i p2_src = _mm256_add_epi32(SAME_MF_CF_FF1, _mm256_set1_epi32(8*N_DOWN));
+
+    // M gaps take precedence, as the scalar kernel returns on them first.
+    __m256i f_gap_mask = _mm256_andnot_si256(gap_mask,
+                                             LaneMask(true, true, profile->f_gap[0][j] != 0, profile->f_gap[1][j] != 0));
+    gap_mask = _mm256_or_si256(gap_mask, f_gap_mask);
+    gap_score = _mm256_blendv_epi8(gap_score, _mm256_max_epi32(p1, p2), f_gap_mask);
+    gap_src = _mm256_blendv_epi8(gap_src,
+                                 _mm256_blendv_epi8(p2_src, p1_src, _mm256_cmpgt_epi32(p1, p2)),
+                                 f_gap_mask);
+
+    // only j decreases. Single deletion from F.
+    score_t ins_1 = profile->f_ins[0][j];
+    score_t ins_2 = profile->f_ins[1][j];
+    __m256i f_ins = Lanes(ins_1, ins_1, ins_2, ins_2, ins_1, ins_1, ins_2, ins_2);
+    UpdateValsAVX2(_mm256_add_epi32(p1, f_ins), p1_src, &max_score, &max_src);
+    UpdateValsAVX2(_mm256_add_epi32(p2, f_ins), p2_src, &max_score, &max_src);
+
+    // k and j decreases: single deletions from C, F aligns.
+    score_t del_0 = profile->f_del[0];
+    score_t del_1 = profile->f_del[1];
+    __m256i f_del = Lanes(f_align[0][0] + del_0, f_align[0][0] + del_0,
+                          f_align[0][1] + del_0, f_align[0][1] + del_0,
+                          f_align[1][0] + del_1, f_align[1][0] + del_1,
+                          f_align[1][1] + del_1, f_align[1][1] + del_1);
+    __m256i back_down = LoadScores(scores->back_down);
+    src_checks[N_BACK_DOWN] = checks->back_down;
+    for (int pre = 0; pre < 4; pre++) {
+      UpdateValsAVX2(_mm256_add_epi32(_mm256_permutevar8x32_epi32(back_down, SAME_MF[pre]), f_del),
+                     _mm256_add_epi32(SAME_MF[pre], _mm256_set1_epi32(8*N_BACK_DOWN)),
+                     &max_score, &max_src);
+    }
+  }
+
+  if (i > 0 && j > 0) {
+    // All 8 predecessors are candidates for every state and the score term
+    // does not depend on the predecessor, so the first maximum of the
+    // previous cell wins for every lane.
+    __m256i back_diag = LoadScores(scores->back_diag);
+    src_checks[N_BACK_DIAG] = checks->back_diag;
+    __m256i diag_max = HorizontalMax(back_diag);
+    int first = __builtin_ctz((unsigned)_mm256_movemask_ps(
+        _mm256_castsi256_ps(_mm256_cmpeq_epi32(back_diag, diag_max))));
+    __m256i aln = Lanes(m_align[0][0] + f_align[0][0], m_align[0][1] + f_align[0][0],
+                        m_align[0][0] + f_align[0][1], m_align[0][1] + f_align[0][1],
+                        m_align[1][0] + f_align[1][0], m_align[1][1] + f_align[1][0],
+                        m_align[1][0] + f_align[1][1], m_align[1][1] + f_align[1][1]);
+    UpdateValsAVX2(_mm256_add_epi32(diag_max, aln),
+                   _mm256_set1_epi32(8*N_BACK_DIAG + first),
+                   &max_score, &max_src);
+  }
+
+  max_score = _mm256_blendv_epi8(max_score, gap_score, gap_mask);
+  StoreScores(scores->curr, max_score, &saturated);
+
+  if (!TRACK) {
+    // max_src and gap_src are dead, the compiler drops them.
+    return;
+  }
+  if (k == mid_k) {
+    Store(checks->curr, _mm256_set1_epi32((int)CellId(i, j)));
+  } else if (k > mid_k) {
+    // The 8 checkpoints of a neighbour fit in one vector, so the sources
+    // are picked with one permutation per neighbour.
+    max_src = _mm256_blendv_epi8(max_src, gap_src, gap_mask);
+    if (CODES) {
+      Store(checks->curr, max_src);
+      return;
+    }
+    __m256i src_state = _mm256_and_si256(max_src, _mm256_set1_epi32(7));
+    __m256i src_neighbour = _mm256_srli_epi32(max_src, 3);
+    __m256i max_check = _mm256_setzero_si256();
+    for (int n = 0; n < N_NEIGHBOURS; n++) {
+      if (src_checks[n] == NULL) {
+        continue;
+      }
+      max_check = _mm256_blendv_epi8(max_check,
+                                     _mm256_permutevar8x32_epi32(Load(src_checks[n]), src_state),
+                                     _mm256_cmpeq_epi32(src_neighbour, _mm256_set1_epi32(n)));
+    }
+    Store(checks->curr, max_check);
+  }
+}
+
+template void Phaser::UpdateCellAVX2<int16_t, false, false>(Neighbourhood<int16_t> *, Neighbourhood<check_t> *,
+                                                            ScoreProfile *, size_t, size_t, size_t, size_t);
+template void Phaser::UpdateCellAVX2<int16_t, true, false>(Neighbourhood<int16_t> *, Neighbourhood<check_t> *,
+                                                           ScoreProfile *, size_t, size_t, size_t, size_t);
+template void Phaser::UpdateCellAVX2<int16_t, true, true>(Neighbourhood<int16_t> *, Neighbourhood<check_t> *,
+                                                          ScoreProfile *, size_t, size_t, size_t, size_t);
+template void Phaser::UpdateCellAVX2<score_t, false, false>(Neighbourhood<score_t> *, Neighbourhood<check_t> *,
+                                                            ScoreProfile *, size_t, size_t, size_t, size_t);
+template void Phaser::UpdateCellAVX2<score_t, true, false>(Neighbourhood<score_t> *, Neighbourhood<check_t> *,
+                                                           ScoreProfile *, size_t, size_t, size_t, size_t);
+template void Phaser::UpdateCellAVX2<score_t, true, true>(Neighbourhood<score_t> *, Neighbourhood<check_t> *,
+                                                          ScoreProfile *, size_t, size_t, size_t, size_t);
+
+// Lanes of the terms [cf][x] of a parent: x is mf for M and ff for F.
+static inline __m256i MLanes(score_t * const align[2][2], size_t i) {
+  return Lanes(align[0][0][i], align[0][1][i], align[0][0][i], align[0][1][i],
+               align[1][0][i], align[1][1][i], align[1][0][i], align[1][1][i]);
+}
+
+static inline __m256i FLanes(score_t * const align[2][2], size_t j) {
+  return Lanes(align[0][0][j], align[0][0][j], align[0][1][j], align[0][1][j],
+               align[1][0][j], align[1][0][j], align[1][1][j], align[1][1][j]);
+}
+
+// The lanes (mf, ff, *) that the moves consuming a symbol of C reach in the
+// cell (i, j), as FromBack in phaser_backward.cpp.
+static inline __m256i FromBackLanes(ScoreProfile * profile, size_t i, size_t j) {
+  return LaneMask(!(i > 0 && profile->m_gap[0][i]), !(i > 0 && profile->m_gap[1][i]),
+                  !(j > 0 && profile->f_gap[0][j]), !(j > 0 && profile->f_gap[1][j]));
+}
+
+// The moves of BackwardPlane become lane permutations of the destination
+// cell. The candidates of the states that a move cannot reach are set to
+// BACKWARD_NONE before taking maxima, so the scores are the same.
+void Phaser::BackwardPlaneAVX2(score_t * curr, const score_t * next, ScoreProfile * profile) {
+  const __m256i NONE = _mm256_set1_epi32(BACKWARD_NONE);
+  const __m256i SWAP_MF = Lanes(1, 0, 3, 2, 5, 4, 7, 6);
+  const __m256i SWAP_FF = Lanes(2, 3, 0, 1, 6, 7, 4, 5);
+  const __m256i SWAP_CF = Lanes(4, 5, 6, 7, 0, 1, 2, 3);
+  const __m256i SAME_MF_FF_CF0 = Lanes(0, 1, 2, 3, 0, 1, 2, 3);
+  const __m256i SAME_MF_FF_CF1 = Lanes(4, 5, 6, 7, 4, 5, 6, 7);
+  const __m256i c_del = _mm256_set1_epi32(profile->c_del);
+  const __m256i m_del = Lanes(profile->m_del[0], profile->m_del[0], profile->m_del[0], profile->m_del[0],
+                              profile->m_del[1], profile->m_del[1], profile->m_del[1], profile->m_del[1]);
+  const __m256i f_del = Lanes(profile->f_del[0], profile->f_del[0], profile->f_del[0], profile->f_del[0],
+                              profile->f_del[1], profile->f_del[1], profile->f_del[1], profile->f_del[1]);
+  for (size_t j = J_len + 1; j-- > 0;) {
+    // Lanes whose F has no gap at j.
+    __m256i f_open = LaneMask(true, true, !(j > 0 && profile->f_gap[0][j]), !(j > 0 && profile->f_gap[1][j]));
+    for (size_t i = I_len + 1; i-- > 0;) {
+      score_t * ans_ptr = curr + 8 * IJ(i, j);
+      if (next == NULL && i == I_len && j == J_len) {
+        Store(ans_ptr, _mm256_setzero_si256());
+        continue;
+      }
+      __m256i ans = NONE;
+
+      if (next != NULL) {
+        // C gets a gap: to (mf, ff, *) of (i, j, k+1).
+        __m256i to = Load(next + 8 * IJ(i, j));
+        __m256i val = _mm256_add_epi32(_mm256_max_epi32(_mm256_permutevar8x32_epi32(to, SAME_MF_FF_CF0),
+                                                        _mm256_permutevar8x32_epi32(to, SAME_MF_FF_CF1)),
+                                       c_del);
+        ans = _mm256_blendv_epi8(NONE, val, FromBackLanes(profile, i, j));
+        // M aligns, c_2 gets a gap: to (*, ff, *) of (i+1, j, k+1).
+        if (i < I_len) {
+          to = Load(next + 8 * IJ(i+1, j));
+          val = _mm256_add_epi32(to, _mm256_add_epi32(MLanes(profile->m_align, i+1), m_del));
+          val = _mm256_blendv_epi8(NONE, val, FromBackLanes(profile, i+1, j));
+          val = _mm256_max_epi32(val, _mm256_permutevar8x32_epi32(val, SWAP_MF));
+          val = _mm256_max_epi32(val, _mm256_permutevar8x32_epi32(val, SWAP_CF));
+          ans = _mm256_max_epi32(ans, val);
+        }
+        // F aligns, c_1 gets a gap: to (mf, *, *) of (i, j+1, k+1).
+        if (j < J_len) {
+          to = Load(next + 8 * IJ(i, j+1));
+          val = _mm256_add_epi32(to, _mm256_add_epi32(FLanes(profile->f_align, j+1), f_del));
+          val = _mm256_blendv_epi8(NONE, val, FromBackLanes(profile, i, j+1));
+          val = _mm256_max_epi32(val, _mm256_permutevar8x32_epi32(val, SWAP_FF));
+          val = _mm256_max_epi32(val, _mm256_permutevar8x32_epi32(val, SWAP_CF));
+          ans = _mm256_max_epi32(ans, val);
+        }
+        // All three align: to any state of (i+1, j+1, k+1).
+        if (i < I_len && j < J_len) {
+          to = Load(next + 8 * IJ(i+1, j+1));
+          val = _mm256_add_epi32(to, _mm256_add_epi32(MLanes(profile->m_align, i+1),
+                                                      FLanes(profile->f_align, j+1)));
+          val = _mm256_blendv_epi8(NONE, val, FromBackLanes(profile, i+1, j+1));
+          ans = _mm256_max_epi32(ans, HorizontalMax(val));
+        }
+      }
+
+      // M gets a gap, or copies one: to (*, ff, cf) of (i+1, j, k).
+      if (i < I_len) {
+        __m256i to = Load(curr + 8 * IJ(i+1, j));
+        bool gap_0 = profile->m_gap[0][i+1];
+        bool gap_1 = profile->m_gap[1][i+1];
+        score_t step_0 = gap_0 ? 0 : profile->m_ins[0][i+1];
+        score_t step_1 = gap_1 ? 0 : profile->m_ins[1][i+1];
+        __m256i val = _mm256_add_epi32(to, Lanes(step_0, step_1, step_0, step_1, step_0, step_1, step_0, step_1));
+        val = _mm256_blendv_epi8(NONE, val, _mm256_or_si256(LaneMask(gap_0, gap_1, true, true), f_open));
+        val = _mm256_max_epi32(val, _mm256_permutevar8x32_epi32(val, SWAP_MF));
+        ans = _mm256_max_epi32(ans, val);
+      }
+      // F gets a gap, or copies one: to (mf, *, cf) of (i, j+1, k), unless M
+      // copies a gap at i.
+      if (j < J_len) {
+        __m256i to = Load(curr + 8 * IJ(i, j+1));
+        score_t step_0 = profile->f_gap[0][j+1] ? 0 : profile->f_ins[0][j+1];
+        score_t step_1 = profile->f_gap[1][j+1] ? 0 : profile->f_ins[1][j+1];
+        __m256i val = _mm256_add_epi32(to, Lanes(step_0, step_0, step_1, step_1, step_0, step_0, step_1, step_1));
+        val = _mm256_max_epi32(val, _mm256_permutevar8x32_epi32(val, SWAP_FF));
+        val = _mm256_blendv_epi8(NONE, val, LaneMask(!(i > 0 && profile->m_gap[0][i]),
+                                                     !(i > 0 && profile->m_gap[1][i]), true, true));
+        ans = _mm256_max_epi32(ans, val);
+      }
+      Store(ans_ptr, ans);
+    }
+  }
+}
+
+#endif  // __AVX2__
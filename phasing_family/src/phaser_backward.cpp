@@ -0,0 +1,156 @@
+/* Copyright (C) 2013, Daniel Valenzuela, all rights reserved.
+ * dvalenzu@cs.helsinki.fi
+ */
+
+// Backward planes of the cube (Phaser::BackwardPlane): B(v, s) is the best
+// score of a path from the state s of the cell v to the last cell. Used with
+// the forward scores by similarity_and_consensus.
+//
+// BackwardPlane follows the moves of UpdateGeneral the other way: a move
+// into the state t of a cell w exists only if UpdateGeneral offers it to t.
+// When a parent has a gap at w, t is only reached along that parent, at no
+// score. The score of a move depends on w and t, so the forward kernels on
+// the reversed sequences would not give B.
+
+#include "./phaser.h"
+#include <cassert>
+#include <algorithm>
+
+// The moves that consume a symbol of C reach the states (mf, ff, *) of the
+// cell (i, j): UpdateGeneral drops them when a parent has a gap there.
+static inline bool FromBack(ScoreProfile * profile, size_t i, size_t j, bool mf, bool ff) {
+  return !(i > 0 && profile->m_gap[mf][i]) && !(j > 0 && profile->f_gap[ff][j]);
+}
+
+static inline void Offer(score_t candidate, score_t * max) {
+  if (candidate > *max) {
+    *max = candidate;
+  }
+}
+
+void Phaser::BackwardPlane(score_t * curr, const score_t * next, ScoreProfile * profile) {
+#ifdef __AVX2__
+  if (use_avx2) {
+    BackwardPlaneAVX2(curr, next, profile);
+    return;
+  }
+#endif
+  for (size_t j = J_len + 1; j-- > 0;) {
+    for (size_t i = I_len + 1; i-- > 0;) {
+      score_t * ans = curr + 8 * IJ(i, j);
+      if (next == NULL && i == I_len && j == J_len) {
+        std::fill(ans, ans + 8, 0);
+        continue;
+      }
+      std::fill(ans, ans + 8, BACKWARD_NONE);
+
+      if (next != NULL) {
+        // C gets a gap: to (mf, ff, *) of (i, j, k+1).
+        const score_t * to = next + 8 * IJ(i, j);
+        for (bool ff : {false, true}) {
+          for (bool mf : {false, true}) {
+            if (!FromBack(profile, i, j, mf, ff)) {
+              continue;
+            }
+            score_t val = profile->c_del + std::max(to[m_index(mf, ff, 0)], to[m_index(mf, ff, 1)]);
+            Offer(val, &ans[m_index(mf, ff, 0)]);
+            Offer(val, &ans[m_index(mf, ff, 1)]);
+          }
+        }
+        // M aligns, c_2 gets a gap: to (*, ff, *) of (i+1, j, k+1).
+        if (i < I_len) {
+          to = next + 8 * IJ(i+1, j);
+          for (bool ff : {false, true}) {
+            score_t val = BACKWARD_NONE;
+            for (bool cf : {false, true}) {
+              for (bool mf : {false, true}) {
+                if (FromBack(profile, i+1, j, mf, ff)) {
+                  Offer(to[m_index(mf, ff, cf)] + profile->m_align[cf][mf][i+1] + profile->m_del[cf], &val);
+                }
+              }
+            }
+            for (bool cf : {false, true}) {
+              Offer(val, &ans[m_index(0, ff, cf)]);
+              Offer(val, &ans[m_index(1, ff, cf)]);
+            }
+          }
+        }
+        // F aligns, c_1 gets a gap: to (mf, *, *) of (i, j+1, k+1).
+        if (j < J_len) {
+          to = next + 8 * IJ(i, j+1);
+          for (bool mf : {false, true}) {
+            score_t val = BACKWARD_NONE;
+            for (bool cf : {false, true}) {
+              for (bool ff : {false, true}) {
+                if (FromBack(profile, i, j+1, mf, ff)) {
+                  Offer(to[m_index(mf, ff, cf)] + profile->f_align[cf][ff][j+1] + profile->f_del[cf], &val);
+                }
+              }
+            }
+            for (bool cf : {false, true}) {
+              Offer(val, &ans[m_index(mf, 0, cf)]);
+              Offer(val, &ans[m_index(mf, 1, cf)]);
+            }
+          }
+        }
+        // All three align: to any state of (i+1, j+1, k+1).
+        if (i < I_len && j < J_len) {
+          to = next + 8 * IJ(i+1, j+1);
+          score_t val = BACKWARD_NONE;
+          for (bool cf : {false, true}) {
+            for (bool ff : {false, true}) {
+              for (bool mf : {false, true}) {
+                if (FromBack(profile, i+1, j+1, mf, ff)) {
+                  Offer(to[m_index(mf, ff, cf)] +
+                        profile->m_align[cf][mf][i+1] + profile->f_align[cf][ff][j+1], &val);
+                }
+              }
+            }
+          }
+          for (size_t m = 0; m < 8; m++) {
+            Offer(val, &ans[m]);
+          }
+        }
+      }
+
+      // M gets a gap, or copies one: to (*, ff, cf) of (i+1, j, k). A gap of
+      // F at j takes the states that M does not copy.
+      if (i < I_len) {
+        const score_t * to = curr + 8 * IJ(i+1, j);
+        for (bool cf : {false, true}) {
+          for (bool ff : {false, true}) {
+            score_t val = BACKWARD_NONE;
+            for (bool mf : {false, true}) {
+              if (profile->m_gap[mf][i+1]) {
+                Offer(to[m_index(mf, ff, cf)], &val);
+              } else if (!(j > 0 && profile->f_gap[ff][j])) {
+                Offer(to[m_index(mf, ff, cf)] + profile->m_ins[mf][i+1], &val);
+              }
+            }
+            Offer(val, &ans[m_index(0, ff, cf)]);
+            Offer(val, &ans[m_index(1, ff, cf)]);
+          }
+        }
+      }
+      // F gets a gap, or copies one: to (mf, *, cf) of (i, j+1, k), unless M
+      // copies a gap at i.
+      if (j < J_len) {
+        const score_t * to = curr + 8 * IJ(i, j+1);
+        for (bool cf : {false, true}) {
+          for (bool mf : {false, true}) {
+            if (i > 0 && profile->m_gap[mf][i]) {
+              continue;
+            }
+            score_t val = BACKWARD_NONE;
+            for (bool ff : {false, true}) {
+              score_t step = profile->f_gap[ff][j+1] ? 0 : profile->f_ins[ff][j+1];
+              Offer(to[m_index(mf, ff, cf)] + step, &val);
+            }
+            Offer(val, &ans[m_index(mf, 0, cf)]);
+            Offer(val, &ans[m_index(mf, 1, cf)]);
+          }
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,240 @@
+/* Copyright (C) 2013, Daniel Valenzuela, all rights reserved.
+ * dvalenzu@cs.helsinki.fi
+ */
+
+// Banded sweep of the k-planes (Phaser::SweepBand).
+// Windows of a trio are near-collinear, so the best path stays close to the
+// diagonal i/I = j/J = k/K of the sub-cube. Plane k only keeps the cells with
+// |i*K/I - k| <= width and |j*K/J - k| <= width, a box of about
+// (2*width*I/K) x (2*width*J/K) cells; the cells out of the band score
+// BAND_OUTSIDE.
+//
+// A path that leaves the band goes through an edge cell e of it, and scores
+// at most best(e) + bound(e): the banded score of e plus an upper bound of
+// any completion from e to the last cell. If that is smaller than the best
+// banded score for every edge cell, the best path of the cube is inside the
+// band, and it is the one the full sweep would pick (ties included, as every
+// candidate the band drops scores less). Otherwise SweepBanded doubles the
+// width and runs again.
+
+#include "./phaser.h"
+#include <cassert>
+#include <algorithm>
+#include <vector>
+#include "./band_face.h"
+
+// Boxes of the band in the planes 0..K_len of a sub-cube.
+class Band {
+ public:
+  Band(size_t _I_len, size_t _J_len, size_t _K_len, size_t width)
+      : I_len(_I_len), J_len(_J_len), K_len(_K_len),
+        i_lo(_K_len + 1), i_hi(_K_len + 1), j_lo(_K_len + 1), j_hi(_K_len + 1) {
+    for (size_t k = 0; k <= K_len; k++) {
+      Range(k, I_len, width, &i_lo[k], &i_hi[k]);
+      Range(k, J_len, width, &j_lo[k], &j_hi[k]);
+    }
+  }
+
+  inline size_t MaxCells() {
+    size_t ans = 0;
+    for (size_t k = 0; k <= K_len; k++) {
+      ans = std::max(ans, (i_hi[k] - i_lo[k] + 1) * (j_hi[k] - j_lo[k] + 1));
+    }
+    return ans;
+  }
+
+  // Cells from which a path may leave the band: the last ones of a row
+  // or column of the box, and the ones that are not in the next box.
+  inline bool Edge(size_t i, size_t j, size_t k) {
+    return (i == i_hi[k] && i_hi[k] < I_len) ||
+        (j == j_hi[k] && j_hi[k] < J_len) ||
+        (k < K_len && (i < i_lo[k+1] || j < j_lo[k+1]));
+  }
+
+  size_t I_len, J_len, K_len;
+  std::vector<size_t> i_lo, i_hi, j_lo, j_hi;
+
+ private:
+  // Positions [*lo, *hi] of a sequence of length len kept in the plane k.
+  inline void Range(size_t k, size_t len, size_t width, size_t * lo, size_t * hi) {
+    *lo = (k > width) ? (k - width) * len / K_len : 0;
+    *hi = std::min(len, ((k + width) * len + K_len - 1) / K_len);
+  }
+};
+
+bool Phaser::SweepBanded(size_t i_ini,
+                         size_t j_ini,
+                         size_t k_ini,
+                         size_t K_len,
+                         size_t mid_k,
+                         score_t * last_scores,
+                         size_t * last_i,
+                         size_t * last_j) {
+  if (band == 0 || ScoreBound(K_len) >= (size_t)(INT_MAX / 4)) {
+    return false;
+  }
+  // With width >= K_len the band is the whole sub-cube.
+  for (size_t width = band; width < K_len; width *= 2) {
+    if (SweepBand(i_ini, j_ini, k_ini, K_len, mid_k, width, last_scores, last_i, last_j)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool Phaser::SweepBand(size_t i_ini,
+                       size_t j_ini,
+                       size_t k_ini,
+                       size_t K_len,
+                       size_t mid_k,
+                       size_t width,
+                       score_t * last_scores,
+                       size_t * last_i,
+                       size_t * last_j) {
+  Band box(I_len, J_len, K_len, width);
+  size_t max_cells = box.MaxCells();
+  assert(max_cells <= (size_t)UINT32_MAX);
+  BandFace prev_face(max_cells);
+  BandFace curr_face(max_cells);
+  ScoreProfile profile(I_len, J_len);
+  InitProfile(&profile, i_ini, j_ini);
+
+  // Upper bound of the paths from (i, j, k) to the last cell:
+  // c_bound[k] + parent_bound(m_solid[i], k) + parent_bound(f_solid[j], k).
+  // Only matches score above 0, at most one per symbol of C left.
+  std::vector<score_t> c_bound(K_len + 1, 0);
+  for (size_t k = K_len; k > 0; k--) {
+    c_bound[k-1] = c_bound[k];
+    for (bool x : {false, true}) {
+      c_bound[k-1] += (C_code[x][k_ini + k-1] == CODE_GAP) ? 0 : pair_scores[PAIR_MATCH];
+    }
+  }
+  // Positions of a parent left where both haplotypes have a symbol: if there
+  // are more than symbols of C left, the extra ones are deleted and cost a gap.
+  std::vector<size_t> m_solid(I_len + 1, 0);
+  for (size_t i = I_len; i > 0; i--) {
+    bool solid = M_code[0][i_ini + i-1] != CODE_GAP && M_code[1][i_ini + i-1] != CODE_GAP;
+    m_solid[i-1] = m_solid[i] + solid;
+  }
+  std::vector<size_t> f_solid(J_len + 1, 0);
+  for (size_t j = J_len; j > 0; j--) {
+    bool solid = F_code[0][j_ini + j-1] != CODE_GAP && F_code[1][j_ini + j-1] != CODE_GAP;
+    f_solid[j-1] = f_solid[j] + solid;
+  }
+  score_t gap = pair_scores[PAIR_GAP];
+  score_t exit_bound = BAND_OUTSIDE;
+
+  std::vector<size_t> & i_lo = box.i_lo;
+  std::vector<size_t> & i_hi = box.i_hi;
+  std::vector<size_t> & j_lo = box.j_lo;
+  std::vector<size_t> & j_hi = box.j_hi;
+  size_t mid_i_lo = 0;
+  size_t mid_j_lo = 0;
+  size_t mid_row = 1;
+  for (size_t k = 0; k <= K_len; k++) {
+    curr_face.SetBox(i_lo[k], i_hi[k], j_lo[k], j_hi[k]);
+    BandPlane(&curr_face, &prev_face, &profile, i_ini, j_ini, k_ini, k, mid_k);
+    if (k == mid_k) {
+      mid_i_lo = i_lo[k];
+      mid_j_lo = j_lo[k];
+      mid_row = i_hi[k] - i_lo[k] + 1;
+    }
+
+    // Best score of the paths that leave the band in this plane.
+    size_t C_left = K_len - k;
+    for (size_t j = j_lo[k]; j <= j_hi[k]; j++) {
+      for (size_t i = i_lo[k]; i <= i_hi[k]; i++) {
+        if (!box.Edge(i, j, k)) {
+          continue;
+        }
+        score_t * cell_scores = curr_face.Scores(i, j);
+        score_t bound = c_bound[k] +
+            gap * (score_t)(m_solid[i] > C_left ? m_solid[i] - C_left : 0) +
+            gap * (score_t)(f_solid[j] > C_left ? f_solid[j] - C_left : 0);
+        exit_bound = std::max(exit_bound, *std::max_element(cell_scores, cell_scores + 8) + bound);
+      }
+    }
+    prev_face.Swap(&curr_face);
+  }
+
+  score_t * cell_scores = prev_face.Scores(I_len, J_len);
+  check_t * cell_checks = prev_face.Checks(I_len, J_len);
+  for (size_t m = 0; m < 8; m++) {
+    last_scores[m] = cell_scores[m];
+    last_i[m] = mid_i_lo + cell_checks[m] % mid_row;
+    last_j[m] = mid_j_lo + cell_checks[m] / mid_row;
+  }
+  return exit_bound < last_scores[BestState(last_scores)];
+}
+
+// Computes the box of curr_face in the plane k, from the one of prev_face.
+// Checkpoints of the mid plane are indices in its box.
+void Phaser::BandPlane(BandFace * curr_face,
+                       BandFace * prev_face,
+                       ScoreProfile * profile,
+                       size_t i_ini,
+                       size_t j_ini,
+                       size_t k_ini,
+                       size_t k,
+                       size_t mid_k) {
+  if (k == 0) {
+    // 8 points, lines and faces, as in SweepRows. The box starts at (0, 0).
+    for (size_t j = 0; j <= curr_face->j_hi; j++) {
+      for (size_t i = 0; i <= curr_face->i_hi; i++) {
+        score_t * cell_scores = curr_face->Scores(i, j);
+        for (bool cf : {false, true}) {
+          for (bool ff : {false, true}) {
+            for (bool mf : {false, true}) {
+              size_t m = m_index(mf, ff, cf);
+              if (i == 0 && j == 0) {
+                cell_scores[m] = 0;
+              } else if (j == 0) {
+                score_t * left_scores = curr_face->Scores(i-1, j);
+                cell_scores[m] = std::max(left_scores[m_index(0, ff, cf)] + profile->m_ins[mf][i],
+                                          left_scores[m_index(1, ff, cf)] + profile->m_ins[mf][i]);
+              } else {
+                score_t * down_scores = curr_face->Scores(i, j-1);
+                cell_scores[m] = std::max(down_scores[m_index(mf, 0, cf)] + profile->f_ins[ff][j],
+                                          down_scores[m_index(mf, 1, cf)] + profile->f_ins[ff][j]);
+              }
+            }
+          }
+        }
+        // Every cell of the plane 0 is its own checkpoint, read when mid_k is 0.
+        check_t * cell_checks = curr_face->Checks(i, j);
+        std::fill(cell_checks, cell_checks + 8, (check_t)curr_face->Offset(i, j));
+      }
+    }
+  } else {
+    FillProfile(profile, i_ini, j_ini, k_ini + k-1, curr_face->i_lo, curr_face->i_hi, curr_face->j_lo, curr_face->j_hi);
+    for (size_t j = curr_face->j_lo; j <= curr_face->j_hi; j++) {
+      for (size_t i = curr_face->i_lo; i <= curr_face->i_hi; i++) {
+        Neighbourhood<score_t> scores;
+        Neighbourhood<check_t> checks;
+        scores.curr = curr_face->Scores(i, j);
+        scores.back = prev_face->Scores(i, j);
+        scores.left = (i > 0) ? curr_face->Scores(i-1, j) : NULL;
+        scores.back_left = (i > 0) ? prev_face->Scores(i-1, j) : NULL;
+        scores.down = (j > 0) ? curr_face->Scores(i, j-1) : NULL;
+        scores.back_down = (j > 0) ? prev_face->Scores(i, j-1) : NULL;
+        scores.back_diag = (i > 0 && j > 0) ? prev_face->Scores(i-1, j-1) : NULL;
+        checks.curr = curr_face->Checks(i, j);
+        checks.back = prev_face->Checks(i, j);
+        checks.left = (i > 0) ? curr_face->Checks(i-1, j) : NULL;
+        checks.back_left = (i > 0) ? prev_face->Checks(i-1, j) : NULL;
+        checks.down = (j > 0) ? curr_face->Checks(i, j-1) : NULL;
+        checks.back_down = (j > 0) ? prev_face->Checks(i, j-1) : NULL;
+        checks.back_diag = (i > 0 && j > 0) ? prev_face->Checks(i-1, j-1) : NULL;
+        if (k > mid_k) {
+          UpdateCell<score_t, true>(&scores, &checks, profile, i, j, k, mid_k);
+        } else {
+          UpdateCell<score_t, false>(&scores, &checks, profile, i, j, k, mid_k);
+        }
+        if (k == mid_k) {
+          // Checkpoints are indices in the box of the mid plane.
+          std::fill(checks.curr, checks.curr + 8, (check_t)curr_face->Offset(i, j));
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,116 @@
+/* Copyright (C) 2013, Daniel Valenzuela, all rights reserved.
+ * dvalenzu@cs.helsinki.fi
+ */
+
+// Co-optimal phasing in one pass (Phaser::similarity_and_consensus).
+// The moves inside a plane keep cf, so every path phases C[k-1] with the cf
+// of its states in the plane k. With F the forward scores of the cube and B
+// the backward ones of BackwardPlane,
+//   best(k, cf) = max over the states s with that cf of the cells v of the
+//                 plane k of F(v, s) + B(v, s)
+// is the best score of the paths that phase C[k-1] as cf. C[k-1] gets '?'
+// when both values of cf reach the optimum, as the co-optimal paths do not
+// agree on it. MultiPassPhaser found such positions by rerunning the whole
+// recursion with the members swapped, which only sees the few paths that
+// the tie-breaks of each run pick. The other value of cf is also how sure
+// the phase is: phase_margins[k] is how much the optimum drops when C[k] is
+// phased the other way, a confidence to threshold on.
+//
+// One backward sweep saves a plane every ~sqrt(K). The forward sweep then
+// goes block by block, each block swept backward again from its saved plane
+// just before: three sweeps in all, and ~2 sqrt(K) planes.
+
+#include "./phaser.h"
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+
+score_t Phaser::similarity_and_consensus() {
+  score_t * best = new score_t[2 * C_len];
+  score_t ans = PhaseMarginals(best);
+  delete[] phase_margins;
+  phase_margins = new score_t[C_len];
+  for (size_t k = 0; k < C_len; k++) {
+    phase_string[k] = ConsensusPhase(best[2*k], best[2*k + 1], ans);
+    phase_margins[k] = ans - std::min(best[2*k], best[2*k + 1]);
+  }
+  delete[] best;
+  PrintPhaseString();
+  return ans;
+}
+
+score_t Phaser::PhaseMarginals(score_t * best) {
+  CollapseGapRuns();
+  I_len = M_len;
+  J_len = F_len;
+  size_t K_len = C_len;
+  size_t plane_size = 8 * (I_len + 1) * (J_len + 1);
+  size_t block = std::max((size_t)1, (size_t)std::ceil(std::sqrt((double)K_len)));
+  size_t n_blocks = (K_len + block - 1) / block;
+  ScoreProfile profile(I_len, J_len);
+  InitProfile(&profile, 0, 0);
+  RollingFace<score_t> face(I_len, J_len+1);
+  FirstPlane(&face, NULL, &profile);
+  if (K_len == 0) {
+    // Nothing to phase, and no plane to save: the block of the last one,
+    // (K_len-1) / block, would wrap around.
+    score_t * last = face.Cell(I_len, J_len);
+    return last[BestState(last)];
+  }
+
+  // saved[b]: the backward plane min(K_len, (b+1) * block), the last one of
+  // the block b. The planes below the first one are not needed yet.
+  score_t * saved = new score_t[n_blocks * plane_size];
+  score_t * curr = new score_t[plane_size];
+  score_t * next = new score_t[plane_size];
+  BackwardPlane(curr, NULL, &profile);
+  for (size_t k = K_len; ; k--) {
+    if (k == K_len || k % block == 0) {
+      std::copy(curr, curr + plane_size, saved + ((k-1) / block) * plane_size);
+    }
+    if (k <= block) {
+      break;
+    }
+    std::swap(curr, next);
+    // Terms of the plane k, which holds C[k-1].
+    FillProfile(&profile, 0, 0, k-1);
+    BackwardPlane(curr, next, &profile);
+  }
+  delete[] curr;
+  delete[] next;
+
+  // Backward planes k_lo+1..k_hi-1 of the current block.
+  score_t * planes = new score_t[(block - 1) * plane_size + 1];
+  for (size_t b = 0; b < n_blocks; b++) {
+    size_t k_lo = b * block;
+    size_t k_hi = std::min(K_len, k_lo + block);
+    score_t * last = saved + b * plane_size;
+    for (size_t k = k_hi - 1; k > k_lo; k--) {
+      FillProfile(&profile, 0, 0, k);
+      BackwardPlane(planes + (k - k_lo - 1) * plane_size,
+                          (k + 1 == k_hi) ? last : planes + (k - k_lo) * plane_size,
+                          &profile);
+    }
+    for (size_t k = k_lo + 1; k <= k_hi; k++) {
+      FillProfile(&profile, 0, 0, k-1);
+      CodePlane<score_t>(&face, &profile, k, NULL);
+      const score_t * backward = (k == k_hi) ? last : planes + (k - k_lo - 1) * plane_size;
+      score_t * plane_best = best + 2 * (k-1);
+      plane_best[0] = plane_best[1] = INT_MIN;
+      for (size_t j = 0; j <= J_len; j++) {
+        for (size_t i = 0; i <= I_len; i++) {
+          const score_t * forward = face.Cell(i, j);
+          const score_t * to_end = backward + 8 * IJ(i, j);
+          for (size_t m = 0; m < 8; m++) {
+            plane_best[m >> 2] = std::max(plane_best[m >> 2], forward[m] + to_end[m]);
+          }
+        }
+      }
+    }
+  }
+  delete[] planes;
+  delete[] saved;
+
+  score_t * last = face.Cell(I_len, J_len);
+  return last[BestState(last)];
+}
@@ -0,0 +1,182 @@
+/* Copyright (C) 2013, Daniel Valenzuela, all rights reserved.
+ * dvalenzu@cs.helsinki.fi
+ */
+
+// Row sweep with difference-encoded planes (Phaser::SweepDeltas).
+// Neighbouring cells of a plane have close scores, so instead of absolute
+// score_t values each cell stores, for every state, the difference with the
+// same state of the cell to its left, in one int8_t. The first cell of a row
+// is stored relative to a per-row base. Score planes are 4 times denser
+// than score_t faces; absolute values are only rebuilt for the two rows of
+// each plane the sweep is working on, and for the last cell given to
+// ExtractMax.
+//
+// Only the scores are encoded. The checkpoints of similarity_and_phase stay
+// in two check_t planes, so the 4x only holds for similarity(); with
+// checkpoints the planes shrink from 8 to 5 bytes per state. The
+// differences only fit with small scores, such as the unit ones of
+// mfc_similarity_phaser: Sweep skips this engine when a single transition
+// does not fit (DeltasFit), and reruns the rows when a sweep saturates.
+
+#include "./phaser.h"
+#include <cassert>
+#include <algorithm>
+#include <vector>
+
+// One k-plane, difference encoded along i.
+class DeltaFace {
+ public:
+  DeltaFace(size_t _I_len, size_t _J_len) {
+    row_len = 8 * (_I_len + 1);
+    deltas = new int8_t[row_len * (_J_len + 1)];
+    bases = new score_t[_J_len + 1];
+  }
+
+  ~DeltaFace() {
+    delete[] deltas;
+    delete[] bases;
+  }
+
+  // Stores the 8*(I_len+1) absolute values of row j. Sets saturated if a
+  // difference does not fit.
+  inline void EncodeRow(size_t j, const score_t * row, bool * saturated) {
+    int8_t * out = deltas + j * row_len;
+    bases[j] = row[0];
+    for (size_t m = 0; m < 8; m++) {
+      out[m] = Narrow<int8_t>(row[m] - bases[j], saturated);
+    }
+    for (size_t x = 8; x < row_len; x++) {
+      out[x] = Narrow<int8_t>(row[x] - row[x - 8], saturated);
+    }
+  }
+
+  inline void DecodeRow(size_t j, score_t * row) {
+    const int8_t * in = deltas + j * row_len;
+    for (size_t m = 0; m < 8; m++) {
+      row[m] = bases[j] + in[m];
+    }
+    for (size_t x = 8; x < row_len; x++) {
+      row[x] = row[x - 8] + in[x];
+    }
+  }
+
+  inline void Swap(DeltaFace * other) {
+    std::swap(deltas, other->deltas);
+    std::swap(bases, other->bases);
+  }
+
+ private:
+  size_t row_len;
+  int8_t * deltas;
+  score_t * bases;
+
+  DeltaFace(const DeltaFace &);
+  DeltaFace & operator=(const DeltaFace &);
+};
+
+void Phaser::SweepDeltas(size_t i_ini,
+                         size_t j_ini,
+                         size_t k_ini,
+                         size_t K_len,
+                         size_t mid_k,
+                         score_t * last_scores,
+                         check_t * last_checks) {
+  size_t n_cells = (I_len+1) * (J_len+1);
+  size_t row_len = 8 * (I_len+1);
+  bool tracking = (last_checks != NULL);
+  DeltaFace prev_face(I_len, J_len);
+  DeltaFace curr_face(I_len, J_len);
+  Face<check_t> prev_check(tracking ? n_cells : 0);
+  Face<check_t> curr_check(tracking ? n_cells : 0);
+  ScoreProfile profile(I_len, J_len);
+  InitProfile(&profile, i_ini, j_ini);
+
+  // Decoded rows j-1 (down) and j of the planes k-1 (back) and k.
+  std::vector<score_t> buffer(4 * row_len);
+  score_t * row = &buffer[0];
+  score_t * down_row = &buffer[row_len];
+  score_t * back_row = &buffer[2 * row_len];
+  score_t * back_down_row = &buffer[3 * row_len];
+
+  // 8 points and 8 lines (j=0):
+  for (size_t m = 0; m < 8; m++) {
+    row[m] = 0;
+  }
+  for (size_t i = 1; i <= I_len; i++) {
+    for (bool cf : {false, true}) {
+      for (bool ff : {false, true}) {
+        for (bool mf : {false, true}) {
+          size_t m = m_index(mf, ff, cf);
+          row[8*i + m] = std::max(row[8*(i-1) + m_index(0, ff, cf)] + profile.m_ins[mf][i],
+                                  row[8*(i-1) + m_index(1, ff, cf)] + profile.m_ins[mf][i]);
+        }
+      }
+    }
+  }
+  prev_face.EncodeRow(0, row, &saturated);
+
+  // 8 faces:
+  for (size_t j = 1; j <= J_len; j++) {
+    std::swap(row, down_row);
+    for (size_t i = 0; i <= I_len; i++) {
+      for (bool cf : {false, true}) {
+        for (bool ff : {false, true}) {
+          for (bool mf : {false, true}) {
+            size_t m = m_index(mf, ff, cf);
+            row[8*i + m] = std::max(down_row[8*i + m_index(mf, 0, cf)] + profile.f_ins[ff][j],
+                                    down_row[8*i + m_index(mf, 1, cf)] + profile.f_ins[ff][j]);
+          }
+        }
+      }
+    }
+    prev_face.EncodeRow(j, row, &saturated);
+  }
+  for (size_t j = 0; tracking && j <= J_len; j++) {
+    for (size_t i = 0; i <= I_len; i++) {
+      std::fill(prev_check.Cell(IJ(i, j)), prev_check.Cell(IJ(i, j)) + 8, CellId(i, j));
+    }
+  }
+
+  // the rest of the faces:
+  for (size_t k = 1; k <= K_len && !saturated; k++) {
+    FillProfile(&profile, i_ini, j_ini, k_ini + k-1);
+    bool track = tracking && k >= mid_k;
+    for (size_t j = 0; j <= J_len; j++) {
+      std::swap(row, down_row);
+      std::swap(back_row, back_down_row);
+      prev_face.DecodeRow(j, back_row);
+      for (size_t i = 0; i <= I_len; i++) {
+        Neighbourhood<score_t> scores;
+        scores.curr = row + 8*i;
+        scores.back = back_row + 8*i;
+        scores.left = (i > 0) ? row + 8*(i-1) : NULL;
+        scores.back_left = (i > 0) ? back_row + 8*(i-1) : NULL;
+        scores.down = (j > 0) ? down_row + 8*i : NULL;
+        scores.back_down = (j > 0) ? back_down_row + 8*i : NULL;
+        scores.back_diag = (i > 0 && j > 0) ? back_down_row + 8*(i-1) : NULL;
+        Neighbourhood<check_t> checks = Neighbourhood<check_t>();
+        if (track) {
+          Neighbours(&curr_check, &prev_check, i, j, &checks);
+          UpdateCell<score_t, true>(&scores, &checks, &profile, i, j, k, mid_k);
+        } else {
+          UpdateCell<score_t, false>(&scores, &checks, &profile, i, j, k, mid_k);
+        }
+      }
+      curr_face.EncodeRow(j, row, &saturated);
+    }
+    prev_face.Swap(&curr_face);
+    if (track) {
+      prev_check.Swap(&curr_check);
+    }
+  }
+  if (saturated) {
+    // partial_aligner reruns the sweep with score_t.
+    return;
+  }
+
+  prev_face.DecodeRow(J_len, row);
+  std::copy(row + 8*I_len, row + 8*I_len + 8, last_scores);
+  if (tracking) {
+    std::copy(prev_check.Cell(IJ(I_len, J_len)), prev_check.Cell(IJ(I_len, J_len)) + 8, last_checks);
+  }
+}
@@ -0,0 +1,280 @@
+/* Copyright (C) 2013, Daniel Valenzuela, all rights reserved.
+ * dvalenzu@cs.helsinki.fi
+ */
+
+// Anti-diagonal sweep of the k-planes (Phaser::SweepDiagonals).
+// Inside a plane, cell (i,j) only depends on (i-1,j) and (i,j-1), so all the
+// cells of an anti-diagonal i+j = d are independent. Planes are stored by
+// diagonals, one array per state, and a diagonal is computed 8 cells at a
+// time: lane l holds cell (i0+l, d-i0-l). The candidates of each state are
+// evaluated in the same order as in UpdateGeneral, so scores and checkpoints
+// are bit-identical to the row sweep.
+
+#include "./phaser.h"
+#include <cassert>
+#include <algorithm>
+#include "./simd.h"
+
+#ifdef __AVX2__
+
+// Diagonals are padded on both sides, so the neighbours of every lane
+// (also of lanes past the end of a diagonal) can be read without checks.
+static const size_t DIAG_PAD = 16;
+
+// Lane l gets last[-l]. Along a diagonal j decreases when i grows,
+// so the F terms of the lanes are read backwards from j = d-i0.
+static inline __m256i LoadReversed(const score_t * last) {
+  return _mm256_permutevar8x32_epi32(Load(last - 7), Lanes(7, 6, 5, 4, 3, 2, 1, 0));
+}
+
+// One k-plane stored by anti-diagonals d = i+j.
+// Checkpoints are stored as the cell id j*(I_len+1) + i.
+class DiagonalFace {
+ public:
+  // Without checks only the scores are stored.
+  DiagonalFace(size_t _I_len, size_t _J_len, bool with_checks) {
+    size_t n_diagonals = _I_len + _J_len + 1;
+    // Two empty diagonals (d = -2 and d = -1) go before the first one.
+    base = new size_t[n_diagonals + 2];
+    size_t offset = DIAG_PAD;
+    for (size_t dd = 0; dd < n_diagonals + 2; dd++) {
+      size_t i_min = 0;
+      size_t i_max = 0;
+      if (dd >= 2) {
+        size_t d = dd - 2;
+        i_min = (d > _J_len) ? d - _J_len : 0;
+        i_max = std::min(d, _I_len);
+      }
+      base[dd] = offset - i_min;
+      offset += i_max - i_min + 1 + DIAG_PAD;
+    }
+    stride = offset;
+    scores = new score_t[8 * stride]();
+    checks = with_checks ? new int[8 * stride]() : NULL;
+  }
+
+  ~DiagonalFace() {
+    delete[] base;
+    delete[] scores;
+    delete[] checks;
+  }
+
+  // p[i] is the cell (i, d-back-i) of state m, on the diagonal d-back.
+  inline score_t * Scores(size_t m, size_t d, size_t back) {
+    return scores + m * stride + base[d + 2 - back];
+  }
+
+  inline int * Checks(size_t m, size_t d, size_t back) {
+    return checks + m * stride + base[d + 2 - back];
+  }
+
+  inline void Swap(DiagonalFace * other) {
+    std::swap(scores, other->scores);
+    std::swap(checks, other->checks);
+  }
+
+ private:
+  size_t * base;
+  size_t stride;
+  score_t * scores;
+  int * checks;
+
+  DiagonalFace(const DiagonalFace &);
+  DiagonalFace & operator=(const DiagonalFace &);
+};
+
+void Phaser::SweepDiagonals(size_t i_ini,
+                            size_t j_ini,
+                            size_t k_ini,
+                            size_t K_len,
+                            size_t mid_k,
+                            score_t * last_scores,
+                            check_t * last_checks) {
+  bool tracking = (last_checks != NULL);
+  DiagonalFace prev_face(I_len, J_len, tracking);
+  DiagonalFace curr_face(I_len, J_len, tracking);
+  const int row = (int)(I_len + 1);
+
+  ScoreProfile profile(I_len, J_len);
+  InitProfile(&profile, i_ini, j_ini);
+
+  // 8 points:
+  for (size_t m = 0; m < 8; m++) {
+    prev_face.Scores(m, 0, 0)[0] = 0;
+    if (tracking) {
+      prev_face.Checks(m, 0, 0)[0] = 0;
+    }
+  }
+
+  // 8 lines (j=0):
+  for (size_t i = 1; i <= I_len; i++) {
+    for (bool cf : {false, true}) {
+      for (bool ff : {false, true}) {
+        for (bool mf : {false, true}) {
+          size_t m = m_index(mf, ff, cf);
+          prev_face.Scores(m, i, 0)[i] =
+              std::max(prev_face.Scores(m_index(0, ff, cf), i, 1)[i-1] + profile.m_ins[mf][i],
+                       prev_face.Scores(m_index(1, ff, cf), i, 1)[i-1] + profile.m_ins[mf][i]);
+          if (tracking) {
+            prev_face.Checks(m, i, 0)[i] = (int)i;
+          }
+        }
+      }
+    }
+  }
+
+  // 8 faces:
+  for (size_t j = 1; j <= J_len; j++) {
+    for (size_t i = 0; i <= I_len; i++) {
+      for (bool cf : {false, true}) {
+        for (bool ff : {false, true}) {
+          for (bool mf : {false, true}) {
+            size_t m = m_index(mf, ff, cf);
+            prev_face.Scores(m, i+j, 0)[i] =
+                std::max(prev_face.Scores(m_index(mf, 0, cf), i+j, 1)[i] + profile.f_ins[ff][j],
+                         prev_face.Scores(m_index(mf, 1, cf), i+j, 1)[i] + profile.f_ins[ff][j]);
+            if (tracking) {
+              prev_face.Checks(m, i+j, 0)[i] = (int)j * row + (int)i;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i lane_offsets = Lanes(0, 1, 2, 3, 4, 5, 6, 7);
+  // the rest of the faces:
+  for (size_t k = 1; k <= K_len; k++) {
+    FillProfile(&profile, i_ini, j_ini, k_ini + k-1);
+    __m256i c_del = _mm256_set1_epi32(profile.c_del);
+    __m256i m_del[2] = {_mm256_set1_epi32(profile.m_del[0]), _mm256_set1_epi32(profile.m_del[1])};
+    __m256i f_del[2] = {_mm256_set1_epi32(profile.f_del[0]), _mm256_set1_epi32(profile.f_del[1])};
+    bool track = tracking && k > mid_k;
+
+    for (size_t d = 0; d <= I_len + J_len; d++) {
+      size_t i_min = (d > J_len) ? d - J_len : 0;
+      size_t i_max = std::min(d, I_len);
+      for (size_t i0 = i_min; i0 <= i_max; i0 += 8) {
+        __m256i lane_i = _mm256_add_epi32(_mm256_set1_epi32((int)i0), lane_offsets);
+        __m256i valid_i = _mm256_cmpgt_epi32(lane_i, zero);
+        __m256i valid_j = _mm256_cmpgt_epi32(_mm256_set1_epi32((int)d), lane_i);
+        __m256i valid_ij = _mm256_and_si256(valid_i, valid_j);
+
+        // The diagonal transition takes the first maximum over the 8 states
+        // of (i-1, j-1, k-1), the same for every state of the cell.
+        __m256i diag_max = Load(prev_face.Scores(0, d, 2) + i0 - 1);
+        __m256i diag_check = track ? Load(prev_face.Checks(0, d, 2) + i0 - 1) : zero;
+        for (size_t pre = 1; pre < 8; pre++) {
+          UpdateValsAVX2(Load(prev_face.Scores(pre, d, 2) + i0 - 1),
+                         track ? Load(prev_face.Checks(pre, d, 2) + i0 - 1) : zero,
+                         &diag_max, &diag_check);
+        }
+
+        for (bool cf : {false, true}) {
+          for (bool ff : {false, true}) {
+            for (bool mf : {false, true}) {
+              size_t m = m_index(mf, ff, cf);
+              __m256i max_score, max_check;
+
+              // only k decreases. Two deletions from C.
+              size_t pre = m_index(mf, ff, 0);
+              max_score = _mm256_add_epi32(Load(prev_face.Scores(pre, d, 0) + i0), c_del);
+              max_check = track ? Load(prev_face.Checks(pre, d, 0) + i0) : zero;
+              pre = m_index(mf, ff, 1);
+              UpdateValsAVX2(_mm256_add_epi32(Load(prev_face.Scores(pre, d, 0) + i0), c_del),
+                             track ? Load(prev_face.Checks(pre, d, 0) + i0) : zero,
+                             &max_score, &max_check);
+
+              // only i decreases. Single deletion from M.
+              size_t pre_1 = m_index(0, ff, cf);
+              size_t pre_2 = m_index(1, ff, cf);
+              __m256i p1 = Load(curr_face.Scores(pre_1, d, 1) + i0 - 1);
+              __m256i p2 = Load(curr_face.Scores(pre_2, d, 1) + i0 - 1);
+              __m256i p1_check = track ? Load(curr_face.Checks(pre_1, d, 1) + i0 - 1) : zero;
+              __m256i p2_check = track ? Load(curr_face.Checks(pre_2, d, 1) + i0 - 1) : zero;
+              // Lanes whose M character is a gap just copy the best neighbour.
+              __m256i m_gap_mask = _mm256_and_si256(Load(profile.m_gap[mf] + i0), valid_i);
+              __m256i gap_score = _mm256_max_epi32(p1, p2);
+              __m256i gap_check = _mm256_blendv_epi8(p2_check, p1_check, _mm256_cmpgt_epi32(p1, p2));
+              __m256i ins = Load(profile.m_ins[mf] + i0);
+              UpdateValsAVX2(_mm256_add_epi32(p1, ins), p1_check, valid_i, &max_score, &max_check);
+              UpdateValsAVX2(_mm256_add_epi32(p2, ins), p2_check, valid_i, &max_score, &max_check);
+
+              // k and i decreases: single deletions from C, M aligns.
+              __m256i m_align_lanes = Load(profile.m_align[cf][mf] + i0);
+              __m256i del = _mm256_add_epi32(m_align_lanes, m_del[cf]);
+              for (bool pre_cf : {false, true}) {
+                for (bool pre_mf : {false, true}) {
+                  pre = m_index(pre_mf, ff, pre_cf);
+                  UpdateValsAVX2(_mm256_add_epi32(Load(prev_face.Scores(pre, d, 1) + i0 - 1), del),
+                                 track ? Load(prev_face.Checks(pre, d, 1) + i0 - 1) : zero,
+                                 valid_i, &max_score, &max_check);
+                }
+              }
+
+              // only j decreases. Single deletion from F.
+              pre_1 = m_index(mf, 0, cf);
+              pre_2 = m_index(mf, 1, cf);
+              p1 = Load(curr_face.Scores(pre_1, d, 1) + i0);
+              p2 = Load(curr_face.Scores(pre_2, d, 1) + i0);
+              p1_check = track ? Load(curr_face.Checks(pre_1, d, 1) + i0) : zero;
+              p2_check = track ? Load(curr_face.Checks(pre_2, d, 1) + i0) : zero;
+              // M gaps take precedence, as UpdateGeneral returns on them first.
+              __m256i f_gap_mask = _mm256_andnot_si256(m_gap_mask,
+                                                       _mm256_and_si256(LoadReversed(profile.f_gap[ff] + (d - i0)), valid_j));
+              gap_score = _mm256_blendv_epi8(gap_score, _mm256_max_epi32(p1, p2), f_gap_mask);
+              gap_check = _mm256_blendv_epi8(gap_check,
+                                             _mm256_blendv_epi8(p2_check, p1_check, _mm256_cmpgt_epi32(p1, p2)),
+                                             f_gap_mask);
+              ins = LoadReversed(profile.f_ins[ff] + (d - i0));
+              UpdateValsAVX2(_mm256_add_epi32(p1, ins), p1_check, valid_j, &max_score, &max_check);
+              UpdateValsAVX2(_mm256_add_epi32(p2, ins), p2_check, valid_j, &max_score, &max_check);
+
+              // k and j decreases: single deletions from C, F aligns.
+              __m256i f_align_lanes = LoadReversed(profile.f_align[cf][ff] + (d - i0));
+              del = _mm256_add_epi32(f_align_lanes, f_del[cf]);
+              for (bool pre_cf : {false, true}) {
+                for (bool pre_ff : {false, true}) {
+                  pre = m_index(mf, pre_ff, pre_cf);
+                  UpdateValsAVX2(_mm256_add_epi32(Load(prev_face.Scores(pre, d, 1) + i0), del),
+                                 track ? Load(prev_face.Checks(pre, d, 1) + i0) : zero,
+                                 valid_j, &max_score, &max_check);
+                }
+              }
+
+              // i, j and k decrease.
+              UpdateValsAVX2(_mm256_add_epi32(diag_max, _mm256_add_epi32(m_align_lanes, f_align_lanes)),
+                             diag_check, valid_ij, &max_score, &max_check);
+
+              __m256i gap_mask = _mm256_or_si256(m_gap_mask, f_gap_mask);
+              Store(curr_face.Scores(m, d, 0) + i0, _mm256_blendv_epi8(max_score, gap_score, gap_mask));
+              if (tracking && k == mid_k) {
+                // cell ids: j*(I_len+1) + i, the one of the lane l is l*I_len
+                // below the one of the lane 0. d*(I_len+1) may not fit in
+                // 32 bits, the cell (i0, d-i0) does (DiagonalsFit).
+                size_t first_cell = (d - i0) * (I_len + 1) + i0;
+                assert(first_cell < (size_t)INT_MAX);
+                Store(curr_face.Checks(m, d, 0) + i0,
+                      _mm256_sub_epi32(_mm256_set1_epi32((int)first_cell),
+                                       _mm256_mullo_epi32(lane_offsets, _mm256_set1_epi32(row - 1))));
+              } else if (track) {
+                Store(curr_face.Checks(m, d, 0) + i0, _mm256_blendv_epi8(max_check, gap_check, gap_mask));
+              }
+            }
+          }
+        }
+      }
+    }
+    prev_face.Swap(&curr_face);
+  }
+
+  for (size_t m = 0; m < 8; m++) {
+    last_scores[m] = prev_face.Scores(m, I_len + J_len, 0)[I_len];
+    if (tracking) {
+      last_checks[m] = (check_t)prev_face.Checks(m, I_len + J_len, 0)[I_len];
+    }
+  }
+}
+
+#endif  // __AVX2__
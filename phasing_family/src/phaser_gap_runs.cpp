@@ -0,0 +1,62 @@
+/* Copyright (C) 2013, Daniel Valenzuela, all rights reserved.
+ * dvalenzu@cs.helsinki.fi
+ */
+
+// Runs of gaps in both haplotypes of a parent (SetGapRuns).
+// Where M1 and M2 both have a gap at i, UpdateGeneral sets every state of
+// (i, j, k) to the best of mf = 0, 1 at (i-1, j, k), and FirstPlane does the
+// same along j = 0. After the first column of such a run both values of mf
+// hold the same scores, so each further column is a copy of it, checkpoints
+// included; only in the plane mid_k a checkpoint names its own cell, and the
+// split moves to the first column of the run. Long insertions in another
+// member of the family leave such runs in the padded sequences. They are
+// collapsed to their first column before the first sweep, so a run costs one
+// column whatever its length. The same holds for F. phase_string follows C,
+// which is not touched; OriginalM and OriginalF map the columns back.
+
+#include "./phaser.h"
+#include <cassert>
+#include <vector>
+
+void Phaser::CollapseGapRuns() {
+  if (!gap_runs || runs_collapsed) {
+    return;
+  }
+  runs_collapsed = true;
+  CollapseRuns(&M1, &M2, &M_len, M_code, runs_M, &m_columns);
+  CollapseRuns(&F1, &F2, &F_len, F_code, runs_F, &f_columns);
+}
+
+void Phaser::CollapseRuns(char ** P1,
+                          char ** P2,
+                          size_t * P_len,
+                          code_t ** P_code,
+                          char ** own,
+                          std::vector<size_t> * columns) {
+  std::vector<size_t> kept;
+  for (size_t p = 0; p < *P_len; p++) {
+    bool gap = (P_code[0][p] == CODE_GAP && P_code[1][p] == CODE_GAP);
+    bool prev_gap = (p > 0 && P_code[0][p-1] == CODE_GAP && P_code[1][p-1] == CODE_GAP);
+    if (!gap || !prev_gap) {
+      kept.push_back(p);
+    }
+  }
+  if (kept.size() == *P_len) {
+    return;
+  }
+  char * P[2] = {*P1, *P2};
+  for (size_t x = 0; x < 2; x++) {
+    own[x] = new char[kept.size()];
+    code_t * code = new code_t[kept.size()];
+    for (size_t p = 0; p < kept.size(); p++) {
+      own[x][p] = P[x][kept[p]];
+      code[p] = P_code[x][kept[p]];
+    }
+    delete[] P_code[x];
+    P_code[x] = code;
+  }
+  *P1 = own[0];
+  *P2 = own[1];
+  *P_len = kept.size();
+  columns->swap(kept);
+}
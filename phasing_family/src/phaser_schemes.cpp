@@ -0,0 +1,519 @@
+/* Copyright (C) 2013, Daniel Valenzuela, all rights reserved.
+ * dvalenzu@cs.helsinki.fi
+ */
+
+// Several scoring schemes in one sweep
+// (Phaser::similarity_and_consensus_schemes).
+// Tuning SCORE_GAP, SCORE_MISMATCH and SCORE_MATCH reran the whole phasing
+// of the same trio once per scheme. The cube, its moves and the gaps that
+// constrain them are the same for every scheme; only the terms of the
+// profile change. So each score is replaced by SCHEME_LANES of them, one
+// per scheme, and the sequences, the profile and the loops are paid once
+// for all of them.
+//
+// The checkpoint recursion of similarity_and_phase splits each scheme at a
+// cell of its own, and the sub-cubes soon differ. The sweeps of
+// PhaseMarginals cover the whole cube whatever the scores, so the schemes
+// follow those, and each gets the phase of similarity_and_consensus: '?'
+// where its co-optimal alignments disagree.
+//
+// The kernels are SchemeFirstPlane, SchemeForwardPlane and
+// SchemeBackwardPlane, the moves of FirstPlane, UpdateGeneral and
+// BackwardPlane on SchemeLanes: one AVX2 vector each, or a loop over the
+// lanes without AVX2.
+//
+// Each plane takes SCHEME_LANES times the memory of PhaseMarginals. Past
+// the budget of SetSchemeBudget, the schemes run one at a time instead.
+
+#include "./phaser.h"
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+#include "./simd.h"
+
+#ifdef __AVX2__
+static inline SchemeLanes Broadcast(score_t val) {
+  SchemeLanes ans;
+  Store(ans.v, _mm256_set1_epi32(val));
+  return ans;
+}
+
+static inline SchemeLanes Sum(const SchemeLanes & a, const SchemeLanes & b) {
+  SchemeLanes ans;
+  Store(ans.v, _mm256_add_epi32(Load(a.v), Load(b.v)));
+  return ans;
+}
+
+static inline SchemeLanes Max(const SchemeLanes & a, const SchemeLanes & b) {
+  SchemeLanes ans;
+  Store(ans.v, _mm256_max_epi32(Load(a.v), Load(b.v)));
+  return ans;
+}
+
+static inline void Offer(const SchemeLanes & candidate, SchemeLanes * max) {
+  Store(max->v, _mm256_max_epi32(Load(max->v), Load(candidate.v)));
+}
+#else
+static inline SchemeLanes Broadcast(score_t val) {
+  SchemeLanes ans;
+  for (size_t l = 0; l < SCHEME_LANES; l++) {
+    ans.v[l] = val;
+  }
+  return ans;
+}
+
+static inline SchemeLanes Sum(const SchemeLanes & a, const SchemeLanes & b) {
+  SchemeLanes ans;
+  for (size_t l = 0; l < SCHEME_LANES; l++) {
+    ans.v[l] = a.v[l] + b.v[l];
+  }
+  return ans;
+}
+
+static inline SchemeLanes Max(const SchemeLanes & a, const SchemeLanes & b) {
+  SchemeLanes ans;
+  for (size_t l = 0; l < SCHEME_LANES; l++) {
+    ans.v[l] = std::max(a.v[l], b.v[l]);
+  }
+  return ans;
+}
+
+static inline void Offer(const SchemeLanes & candidate, SchemeLanes * max) {
+  for (size_t l = 0; l < SCHEME_LANES; l++) {
+    max->v[l] = std::max(max->v[l], candidate.v[l]);
+  }
+}
+#endif
+
+// As FromBack in phaser_backward.cpp.
+static inline bool FromBack(SchemeProfile * profile, size_t i, size_t j, bool mf, bool ff) {
+  return !(i > 0 && profile->m_gap[mf][i]) && !(j > 0 && profile->f_gap[ff][j]);
+}
+
+// Phaser::score of two symbols under each scheme.
+static void SchemeScore(const ScoringScheme * lanes,
+                        code_t a,
+                        code_t b,
+                        char a_char,
+                        char b_char,
+                        SchemeLanes * ans) {
+  pair_t kind = PAIR_KINDS[(a << 3) | b];
+  if (kind == PAIR_OTHERS) {
+    kind = (a_char == b_char) ? PAIR_MATCH : PAIR_MISMATCH;
+  }
+  for (size_t l = 0; l < SCHEME_LANES; l++) {
+    switch (kind) {
+      case PAIR_MATCH:
+        ans->v[l] = lanes[l].match;
+        break;
+      case PAIR_MISMATCH:
+        ans->v[l] = lanes[l].mismatch;
+        break;
+      case PAIR_GAP:
+        ans->v[l] = lanes[l].gap;
+        break;
+      default:
+        ans->v[l] = 0;
+    }
+  }
+}
+
+void Phaser::similarity_and_consensus_schemes(const ScoringScheme * schemes,
+                                              size_t n_schemes,
+                                              score_t * scores,
+                                              char ** phases) {
+  CollapseGapRuns();
+  I_len = M_len;
+  J_len = F_len;
+  if (SchemeBytes() > scheme_budget) {
+    // One scheme at a time, on the pair_scores of this phaser.
+    ScoringScheme own = {SCORE_GAP, SCORE_MISMATCH, SCORE_MATCH};
+    score_t * single = new score_t[2 * C_len];
+    for (size_t s = 0; s < n_schemes; s++) {
+      SetScoreGap(schemes[s].gap);
+      SetScoreMismatch(schemes[s].mismatch);
+      SetScoreMatch(schemes[s].match);
+      scores[s] = PhaseMarginals(single);
+      for (size_t k = 0; k < C_len; k++) {
+        phases[s][k] = ConsensusPhase(single[2*k], single[2*k + 1], scores[s]);
+      }
+    }
+    SetScoreGap(own.gap);
+    SetScoreMismatch(own.mismatch);
+    SetScoreMatch(own.match);
+    delete[] single;
+    return;
+  }
+  SchemeLanes * best = new SchemeLanes[2 * C_len];
+  for (size_t first = 0; first < n_schemes; first += SCHEME_LANES) {
+    // The lanes past the last scheme repeat it.
+    ScoringScheme lanes[SCHEME_LANES];
+    for (size_t l = 0; l < SCHEME_LANES; l++) {
+      lanes[l] = schemes[std::min(first + l, n_schemes - 1)];
+      assert(lanes[l].gap < 0 && lanes[l].mismatch < 0 && lanes[l].match > 0);
+    }
+    SchemeLanes ans;
+    SchemeMarginals(lanes, best, &ans);
+    for (size_t l = 0; l < SCHEME_LANES && first + l < n_schemes; l++) {
+      scores[first + l] = ans.v[l];
+      for (size_t k = 0; k < C_len; k++) {
+        phases[first + l][k] = ConsensusPhase(best[2*k].v[l], best[2*k + 1].v[l], ans.v[l]);
+      }
+    }
+  }
+  delete[] best;
+}
+
+// Blocks of PhaseMarginals: the saved planes, the planes of a block, and
+// the two being swept.
+size_t Phaser::SchemeBytes() {
+  size_t K_len = C_len;
+  size_t plane_size = 8 * (I_len + 1) * (J_len + 1);
+  size_t block = std::max((size_t)1, (size_t)std::ceil(std::sqrt((double)K_len)));
+  size_t n_blocks = (K_len + block - 1) / block;
+  size_t lanes = plane_size * (n_blocks + block + 1) + 8 * (I_len + J_len + 2) + 2 * K_len;
+  return lanes * sizeof(SchemeLanes);
+}
+
+void Phaser::SchemeMarginals(const ScoringScheme * lanes, SchemeLanes * best, SchemeLanes * ans) {
+  CollapseGapRuns();
+  I_len = M_len;
+  J_len = F_len;
+  size_t K_len = C_len;
+  size_t plane_size = 8 * (I_len + 1) * (J_len + 1);
+  size_t block = std::max((size_t)1, (size_t)std::ceil(std::sqrt((double)K_len)));
+  size_t n_blocks = (K_len + block - 1) / block;
+  SchemeProfile profile(I_len, J_len);
+  InitSchemeProfile(lanes, &profile);
+
+  // Same blocks as PhaseMarginals.
+  SchemeLanes * saved = new SchemeLanes[n_blocks * plane_size];
+  SchemeLanes * curr = new SchemeLanes[plane_size];
+  SchemeLanes * next = new SchemeLanes[plane_size];
+  SchemeBackwardPlane(curr, NULL, &profile);
+  for (size_t k = K_len; ; k--) {
+    if (k == K_len || k % block == 0) {
+      std::copy(curr, curr + plane_size, saved + ((k-1) / block) * plane_size);
+    }
+    if (k <= block) {
+      break;
+    }
+    std::swap(curr, next);
+    FillSchemeProfile(lanes, &profile, k-1);
+    SchemeBackwardPlane(curr, next, &profile);
+  }
+
+  SchemeLanes * planes = new SchemeLanes[(block - 1) * plane_size + 1];
+  SchemeFirstPlane(curr, &profile);
+  for (size_t b = 0; b < n_blocks; b++) {
+    size_t k_lo = b * block;
+    size_t k_hi = std::min(K_len, k_lo + block);
+    SchemeLanes * last = saved + b * plane_size;
+    for (size_t k = k_hi - 1; k > k_lo; k--) {
+      FillSchemeProfile(lanes, &profile, k);
+      SchemeBackwardPlane(planes + (k - k_lo - 1) * plane_size,
+                          (k + 1 == k_hi) ? last : planes + (k - k_lo) * plane_size,
+                          &profile);
+    }
+    for (size_t k = k_lo + 1; k <= k_hi; k++) {
+      FillSchemeProfile(lanes, &profile, k-1);
+      std::swap(curr, next);
+      SchemeForwardPlane(curr, next, &profile);
+      const SchemeLanes * backward = (k == k_hi) ? last : planes + (k - k_lo - 1) * plane_size;
+      SchemeLanes * plane_best = best + 2 * (k-1);
+      plane_best[0] = plane_best[1] = Broadcast(INT_MIN);
+      for (size_t x = 0; x < plane_size; x++) {
+        Offer(Sum(curr[x], backward[x]), &plane_best[(x & 7) >> 2]);
+      }
+    }
+  }
+
+  const SchemeLanes * last_cell = curr + 8 * IJ(I_len, J_len);
+  *ans = last_cell[0];
+  for (size_t m = 1; m < 8; m++) {
+    Offer(last_cell[m], ans);
+  }
+  delete[] planes;
+  delete[] saved;
+  delete[] curr;
+  delete[] next;
+}
+
+// InitProfile and FillProfile of the whole cube, for each scheme.
+void Phaser::InitSchemeProfile(const ScoringScheme * lanes, SchemeProfile * profile) {
+  for (bool x : {false, true}) {
+    char * M = x ? M2 : M1;
+    char * F = x ? F2 : F1;
+    for (size_t i = 0; i <= I_len; i++) {
+      code_t m_code = (i > 0) ? M_code[x][i-1] : CODE_BOUNDARY;
+      SchemeScore(lanes, m_code, CODE_GAP, (i > 0) ? M[i-1] : '-', '-', &profile->m_ins[x][i]);
+      profile->m_gap[x][i] = (m_code == CODE_GAP);
+    }
+    for (size_t j = 0; j <= J_len; j++) {
+      code_t f_code = (j > 0) ? F_code[x][j-1] : CODE_BOUNDARY;
+      SchemeScore(lanes, f_code, CODE_GAP, (j > 0) ? F[j-1] : '-', '-', &profile->f_ins[x][j]);
+      profile->f_gap[x][j] = (f_code == CODE_GAP);
+    }
+  }
+}
+
+void Phaser::FillSchemeProfile(const ScoringScheme * lanes, SchemeProfile * profile, size_t k) {
+  for (bool cf : {false, true}) {
+    code_t c_1 = C_code[cf][k];
+    code_t c_2 = C_code[!cf][k];
+    char c_char_1 = cf ? C2[k] : C1[k];
+    char c_char_2 = cf ? C1[k] : C2[k];
+    for (bool x : {false, true}) {
+      char * M = x ? M2 : M1;
+      char * F = x ? F2 : F1;
+      SchemeLanes * m_align = profile->m_align[cf][x];
+      SchemeLanes * f_align = profile->f_align[cf][x];
+      m_align[0] = f_align[0] = Broadcast(0);
+      for (size_t i = 1; i <= I_len; i++) {
+        SchemeScore(lanes, c_1, M_code[x][i-1], c_char_1, M[i-1], &m_align[i]);
+      }
+      for (size_t j = 1; j <= J_len; j++) {
+        SchemeScore(lanes, c_2, F_code[x][j-1], c_char_2, F[j-1], &f_align[j]);
+      }
+    }
+    SchemeScore(lanes, c_2, CODE_GAP, c_char_2, '-', &profile->m_del[cf]);
+    SchemeScore(lanes, c_1, CODE_GAP, c_char_1, '-', &profile->f_del[cf]);
+  }
+  SchemeLanes del_1;
+  SchemeLanes del_2;
+  SchemeScore(lanes, C_code[0][k], CODE_GAP, C1[k], '-', &del_1);
+  SchemeScore(lanes, C_code[1][k], CODE_GAP, C2[k], '-', &del_2);
+  profile->c_del = Sum(del_1, del_2);
+}
+
+void Phaser::SchemeFirstPlane(SchemeLanes * plane, SchemeProfile * profile) {
+  for (size_t m = 0; m < 8; m++) {
+    plane[m] = Broadcast(0);
+  }
+  for (size_t i = 1; i <= I_len; i++) {
+    SchemeLanes * cell = plane + 8 * IJ(i, 0);
+    const SchemeLanes * left = plane + 8 * IJ(i-1, 0);
+    for (bool cf : {false, true}) {
+      for (bool ff : {false, true}) {
+        for (bool mf : {false, true}) {
+          cell[m_index(mf, ff, cf)] = Sum(Max(left[m_index(0, ff, cf)], left[m_index(1, ff, cf)]),
+                                          profile->m_ins[mf][i]);
+        }
+      }
+    }
+  }
+  for (size_t j = 1; j <= J_len; j++) {
+    for (size_t i = 0; i <= I_len; i++) {
+      SchemeLanes * cell = plane + 8 * IJ(i, j);
+      const SchemeLanes * down = plane + 8 * IJ(i, j-1);
+      for (bool cf : {false, true}) {
+        for (bool ff : {false, true}) {
+          for (bool mf : {false, true}) {
+            cell[m_index(mf, ff, cf)] = Sum(Max(down[m_index(mf, 0, cf)], down[m_index(mf, 1, cf)]),
+                                            profile->f_ins[ff][j]);
+          }
+        }
+      }
+    }
+  }
+}
+
+// The maxima over the predecessors are shared by several states, as in
+// UpdateShared, and then each state adds its own terms.
+void Phaser::SchemeForwardPlane(SchemeLanes * curr, const SchemeLanes * prev, SchemeProfile * profile) {
+  for (size_t j = 0; j <= J_len; j++) {
+    for (size_t i = 0; i <= I_len; i++) {
+      SchemeLanes * ans = curr + 8 * IJ(i, j);
+      const SchemeLanes * back = prev + 8 * IJ(i, j);
+      SchemeLanes c_ins[2][2];
+      for (bool ff : {false, true}) {
+        for (bool mf : {false, true}) {
+          c_ins[mf][ff] = Sum(Max(back[m_index(mf, ff, 0)], back[m_index(mf, ff, 1)]), profile->c_del);
+        }
+      }
+      // [ff][cf] from (i-1, j, k), and [ff] from (i-1, j, k-1).
+      SchemeLanes m_left[2][2] = {};
+      SchemeLanes m_back[2] = {};
+      if (i > 0) {
+        const SchemeLanes * left = curr + 8 * IJ(i-1, j);
+        const SchemeLanes * back_left = prev + 8 * IJ(i-1, j);
+        for (bool ff : {false, true}) {
+          for (bool cf : {false, true}) {
+            m_left[ff][cf] = Max(left[m_index(0, ff, cf)], left[m_index(1, ff, cf)]);
+          }
+          m_back[ff] = Max(Max(back_left[m_index(0, ff, 0)], back_left[m_index(1, ff, 0)]),
+                           Max(back_left[m_index(0, ff, 1)], back_left[m_index(1, ff, 1)]));
+        }
+      }
+      // [mf][cf] from (i, j-1, k), and [mf] from (i, j-1, k-1).
+      SchemeLanes f_down[2][2] = {};
+      SchemeLanes f_back[2] = {};
+      if (j > 0) {
+        const SchemeLanes * down = curr + 8 * IJ(i, j-1);
+        const SchemeLanes * back_down = prev + 8 * IJ(i, j-1);
+        for (bool mf : {false, true}) {
+          for (bool cf : {false, true}) {
+            f_down[mf][cf] = Max(down[m_index(mf, 0, cf)], down[m_index(mf, 1, cf)]);
+          }
+          f_back[mf] = Max(Max(back_down[m_index(mf, 0, 0)], back_down[m_index(mf, 1, 0)]),
+                           Max(back_down[m_index(mf, 0, 1)], back_down[m_index(mf, 1, 1)]));
+        }
+      }
+      SchemeLanes diag = Broadcast(0);
+      if (i > 0 && j > 0) {
+        const SchemeLanes * back_diag = prev + 8 * IJ(i-1, j-1);
+        diag = back_diag[0];
+        for (size_t m = 1; m < 8; m++) {
+          Offer(back_diag[m], &diag);
+        }
+      }
+
+      for (bool cf : {false, true}) {
+        for (bool ff : {false, true}) {
+          for (bool mf : {false, true}) {
+            size_t m = m_index(mf, ff, cf);
+            // A parent with a gap is copied, as in UpdateGeneral.
+            if (i > 0 && profile->m_gap[mf][i]) {
+              ans[m] = m_left[ff][cf];
+              continue;
+            }
+            if (j > 0 && profile->f_gap[ff][j]) {
+              ans[m] = f_down[mf][cf];
+              continue;
+            }
+            SchemeLanes val = c_ins[mf][ff];
+            if (i > 0) {
+              Offer(Sum(m_left[ff][cf], profile->m_ins[mf][i]), &val);
+              Offer(Sum(m_back[ff], Sum(profile->m_align[cf][mf][i], profile->m_del[cf])), &val);
+            }
+            if (j > 0) {
+              Offer(Sum(f_down[mf][cf], profile->f_ins[ff][j]), &val);
+              Offer(Sum(f_back[mf], Sum(profile->f_align[cf][ff][j], profile->f_del[cf])), &val);
+            }
+            if (i > 0 && j > 0) {
+              Offer(Sum(diag, Sum(profile->m_align[cf][mf][i], profile->f_align[cf][ff][j])), &val);
+            }
+            ans[m] = val;
+          }
+        }
+      }
+    }
+  }
+}
+
+// The moves of BackwardPlane. As in SchemeForwardPlane, the best
+// move of each group is found once per cell, and then offered to the
+// states it leaves from.
+void Phaser::SchemeBackwardPlane(SchemeLanes * curr, const SchemeLanes * next, SchemeProfile * profile) {
+  const SchemeLanes none = Broadcast(BACKWARD_NONE);
+  for (size_t j = J_len + 1; j-- > 0;) {
+    for (size_t i = I_len + 1; i-- > 0;) {
+      SchemeLanes * ans = curr + 8 * IJ(i, j);
+      if (next == NULL && i == I_len && j == J_len) {
+        std::fill(ans, ans + 8, Broadcast(0));
+        continue;
+      }
+      // C gets a gap: [mf][ff], to (mf, ff, *) of (i, j, k+1).
+      SchemeLanes c_del[2][2];
+      // M aligns, c_2 gets a gap: [ff], to (*, ff, *) of (i+1, j, k+1).
+      SchemeLanes m_next[2] = {none, none};
+      // F aligns, c_1 gets a gap: [mf], to (mf, *, *) of (i, j+1, k+1).
+      SchemeLanes f_next[2] = {none, none};
+      // All three align: to any state of (i+1, j+1, k+1).
+      SchemeLanes diag = none;
+      for (bool ff : {false, true}) {
+        for (bool mf : {false, true}) {
+          c_del[mf][ff] = none;
+          if (next != NULL && FromBack(profile, i, j, mf, ff)) {
+            const SchemeLanes * to = next + 8 * IJ(i, j);
+            c_del[mf][ff] = Sum(profile->c_del, Max(to[m_index(mf, ff, 0)], to[m_index(mf, ff, 1)]));
+          }
+        }
+      }
+      if (next != NULL && i < I_len) {
+        const SchemeLanes * to = next + 8 * IJ(i+1, j);
+        for (bool ff : {false, true}) {
+          for (bool cf : {false, true}) {
+            for (bool mf : {false, true}) {
+              if (FromBack(profile, i+1, j, mf, ff)) {
+                Offer(Sum(to[m_index(mf, ff, cf)],
+                          Sum(profile->m_align[cf][mf][i+1], profile->m_del[cf])), &m_next[ff]);
+              }
+            }
+          }
+        }
+      }
+      if (next != NULL && j < J_len) {
+        const SchemeLanes * to = next + 8 * IJ(i, j+1);
+        for (bool mf : {false, true}) {
+          for (bool cf : {false, true}) {
+            for (bool ff : {false, true}) {
+              if (FromBack(profile, i, j+1, mf, ff)) {
+                Offer(Sum(to[m_index(mf, ff, cf)],
+                          Sum(profile->f_align[cf][ff][j+1], profile->f_del[cf])), &f_next[mf]);
+              }
+            }
+          }
+        }
+      }
+      if (next != NULL && i < I_len && j < J_len) {
+        const SchemeLanes * to = next + 8 * IJ(i+1, j+1);
+        for (bool cf : {false, true}) {
+          for (bool ff : {false, true}) {
+            for (bool mf : {false, true}) {
+              if (FromBack(profile, i+1, j+1, mf, ff)) {
+                Offer(Sum(to[m_index(mf, ff, cf)],
+                          Sum(profile->m_align[cf][mf][i+1], profile->f_align[cf][ff][j+1])), &diag);
+              }
+            }
+          }
+        }
+      }
+
+      // M gets a gap, or copies one: [ff][cf], to (*, ff, cf) of (i+1, j, k).
+      SchemeLanes m_plane[2][2];
+      // F gets a gap, or copies one: [mf][cf], to (mf, *, cf) of (i, j+1, k).
+      SchemeLanes f_plane[2][2];
+      for (bool cf : {false, true}) {
+        for (bool ff : {false, true}) {
+          m_plane[ff][cf] = none;
+          for (bool mf : {false, true}) {
+            if (i == I_len) {
+              break;
+            }
+            const SchemeLanes & to = curr[8 * IJ(i+1, j) + m_index(mf, ff, cf)];
+            if (profile->m_gap[mf][i+1]) {
+              Offer(to, &m_plane[ff][cf]);
+            } else if (!(j > 0 && profile->f_gap[ff][j])) {
+              Offer(Sum(to, profile->m_ins[mf][i+1]), &m_plane[ff][cf]);
+            }
+          }
+        }
+        for (bool mf : {false, true}) {
+          f_plane[mf][cf] = none;
+          for (bool ff : {false, true}) {
+            if (j == J_len) {
+              break;
+            }
+            const SchemeLanes & to = curr[8 * IJ(i, j+1) + m_index(mf, ff, cf)];
+            Offer(profile->f_gap[ff][j+1] ? to : Sum(to, profile->f_ins[ff][j+1]), &f_plane[mf][cf]);
+          }
+        }
+      }
+
+      for (bool cf : {false, true}) {
+        for (bool ff : {false, true}) {
+          for (bool mf : {false, true}) {
+            SchemeLanes val = Max(Max(c_del[mf][ff], diag), Max(m_next[ff], f_next[mf]));
+            Offer(m_plane[ff][cf], &val);
+            // F does not move while M copies a gap at i.
+            if (!(i > 0 && profile->m_gap[mf][i])) {
+              Offer(f_plane[mf][cf], &val);
+            }
+            ans[m_index(mf, ff, cf)] = val;
+          }
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,67 @@
+/* Copyright (C) 2013, Daniel Valenzuela, all rights reserved.
+ * dvalenzu@cs.helsinki.fi
+ */
+
+// Small sub-cubes (Phaser::SmallAligner, SetSmallPlanes).
+// The recursion of aligner goes down to sub-cubes of one plane, about one
+// per symbol of C, and each allocated its planes and profile. The sub-cubes
+// of at most small_planes planes that fit SMALL_BYTES are solved here by
+// TRACEBACK_FULL instead, on planes, profile and codes carved from a buffer
+// on the stack: nothing is allocated, and nothing recursed below them. Whole
+// problems that small take the same path.
+//
+// On a sub-cube of one plane the best path leaves it in the best state of
+// its last cell, the phase the recursion writes: the default small_planes,
+// 1, leaves the phasing as it was.
+
+#include "./phaser.h"
+#include <cassert>
+#include <algorithm>
+
+// Stack buffer of SmallAligner.
+static const size_t SMALL_BYTES = 1 << 16;
+
+bool Phaser::SmallFits(size_t K_len) {
+  size_t bytes = sizeof(score_t) * (ScoreProfile::BufferSize(I_len, J_len) +
+                                    RollingFace<score_t>::BufferSize(I_len, J_len+1));
+  bytes += 8 * (I_len + 1) * (J_len + 1) * K_len;
+  return bytes <= SMALL_BYTES;
+}
+
+score_t Phaser::SmallAligner(size_t i_ini,
+                             size_t j_ini,
+                             size_t k_ini,
+                             size_t K_len) {
+  assert(SmallFits(K_len));
+  alignas(32) unsigned char arena[SMALL_BYTES];
+  bool narrow = (score_width == WIDTH_16) ||
+      (score_width == WIDTH_AUTO && ScoreBound(K_len) <= (size_t)INT16_MAX);
+  saturated = false;
+  score_t ans = 0;
+  if (narrow) {
+    ans = SmallTraceback<int16_t>(i_ini, j_ini, k_ini, K_len, arena);
+  }
+  if (!narrow || saturated) {
+    saturated = false;
+    ans = SmallTraceback<score_t>(i_ini, j_ini, k_ini, K_len, arena);
+  }
+  return ans;
+}
+
+template<typename SCORE>
+score_t Phaser::SmallTraceback(size_t i_ini,
+                               size_t j_ini,
+                               size_t k_ini,
+                               size_t K_len,
+                               unsigned char * arena) {
+  score_t * profile_buffer = reinterpret_cast<score_t *>(arena);
+  SCORE * face_buffer = reinterpret_cast<SCORE *>(profile_buffer + ScoreProfile::BufferSize(I_len, J_len));
+  uint8_t * codes = reinterpret_cast<uint8_t *>(face_buffer + RollingFace<SCORE>::BufferSize(I_len, J_len+1));
+  assert(codes + 8 * (I_len + 1) * (J_len + 1) * K_len <= arena + SMALL_BYTES);
+  ScoreProfile profile(I_len, J_len, profile_buffer);
+  RollingFace<SCORE> face(I_len, J_len+1, face_buffer);
+  return FullTraceback(i_ini, j_ini, k_ini, K_len, &face, &profile, codes);
+}
+
+template score_t Phaser::SmallTraceback<int16_t>(size_t, size_t, size_t, size_t, unsigned char *);
+template score_t Phaser::SmallTraceback<score_t>(size_t, size_t, size_t, size_t, unsigned char *);
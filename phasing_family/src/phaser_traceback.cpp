@@ -0,0 +1,211 @@
+/* Copyright (C) 2013, Daniel Valenzuela, all rights reserved.
+ * dvalenzu@cs.helsinki.fi
+ */
+
+// Traceback engine of Phaser::aligner (SetTraceback, SetMemoryBudget).
+// The checkpoint recursion keeps two planes, but sweeps each level of the
+// recursion again: about twice the time of similarity(). When the sub-cube
+// fits in the budget, TRACEBACK_FULL follows the best path back instead.
+//
+// The kernels copy the checkpoint of a state from the predecessor they pick.
+// Given the codes 8 * neighbour + state (SOURCES) as the checkpoints of the
+// neighbours, they write the code of that predecessor: the same choice as
+// the other sweeps, ties included, from any kernel. The AVX2 one has the
+// codes at hand, and stores them directly.
+//
+// TRACEBACK_FULL keeps the codes of every plane, a byte per state and cell.
+//
+// Among co-optimal paths, the codes keep the choice of one sweep of the
+// whole sub-cube. The recursion instead starts each half afresh from the
+// best state of its mid-plane cell, so where several phasings reach the
+// optimum the two engines may return different ones, of the same score.
+// similarity_and_consensus marks those positions with '?'.
+//
+// Only the moves that consume a symbol of C leave a plane, and the moves
+// inside a plane keep cf. So the phase of C[k-1] is the cf of the state in
+// which the best path leaves the plane k.
+
+#include "./phaser.h"
+#include <cassert>
+#include <algorithm>
+
+// Checkpoints of each neighbour, as the kernels read them.
+static check_t SOURCES[N_NEIGHBOURS][8] = {
+  { 0,  1,  2,  3,  4,  5,  6,  7},
+  { 8,  9, 10, 11, 12, 13, 14, 15},
+  {16, 17, 18, 19, 20, 21, 22, 23},
+  {24, 25, 26, 27, 28, 29, 30, 31},
+  {32, 33, 34, 35, 36, 37, 38, 39},
+  {40, 41, 42, 43, 44, 45, 46, 47}};
+
+traceback_t Phaser::PickTraceback(size_t K_len) {
+  if (traceback != TRACEBACK_AUTO) {
+    return traceback;
+  }
+  // The banded and pruned sweeps only run inside the recursion.
+  if (band > 0 || wavefront || projection_bounds) {
+    return TRACEBACK_CHECKPOINTS;
+  }
+  if (TracebackBytes(TRACEBACK_FULL, K_len) <= memory_budget) {
+    return TRACEBACK_FULL;
+  }
+  return TRACEBACK_CHECKPOINTS;
+}
+
+size_t Phaser::TracebackBytes(traceback_t engine, size_t K_len) {
+  size_t plane = 8 * (I_len + 1) * (J_len + 1);
+  switch (engine) {
+    case TRACEBACK_FULL:
+      return plane * (K_len + sizeof(score_t));
+    default:
+      return 2 * plane * (sizeof(score_t) + sizeof(check_t));
+  }
+}
+
+score_t Phaser::TraceAligner(size_t i_ini,
+                             size_t j_ini,
+                             size_t k_ini,
+                             size_t K_len) {
+  bool narrow = (score_width == WIDTH_16) ||
+      (score_width == WIDTH_AUTO && ScoreBound(K_len) <= (size_t)INT16_MAX);
+  saturated = false;
+  score_t ans = 0;
+  if (narrow) {
+    ans = FullTraceback<int16_t>(i_ini, j_ini, k_ini, K_len);
+  }
+  if (!narrow || saturated) {
+    saturated = false;
+    ans = FullTraceback<score_t>(i_ini, j_ini, k_ini, K_len);
+  }
+  return ans;
+}
+
+template<typename SCORE>
+score_t Phaser::FullTraceback(size_t i_ini,
+                              size_t j_ini,
+                              size_t k_ini,
+                              size_t K_len) {
+  size_t plane_codes = 8 * (I_len + 1) * (J_len + 1);
+  uint8_t * codes = new uint8_t[plane_codes * K_len];
+  RollingFace<SCORE> face(I_len, J_len+1);
+  ScoreProfile profile(I_len, J_len);
+  score_t ans = FullTraceback(i_ini, j_ini, k_ini, K_len, &face, &profile, codes);
+  delete[] codes;
+  return ans;
+}
+
+template<typename SCORE>
+score_t Phaser::FullTraceback(size_t i_ini,
+                              size_t j_ini,
+                              size_t k_ini,
+                              size_t K_len,
+                              RollingFace<SCORE> * face,
+                              ScoreProfile * profile,
+                              uint8_t * codes) {
+  size_t plane_codes = 8 * (I_len + 1) * (J_len + 1);
+  InitProfile(profile, i_ini, j_ini);
+  FirstPlane(face, NULL, profile);
+  for (size_t k = 1; k <= K_len && !saturated; k++) {
+    FillProfile(profile, i_ini, j_ini, k_ini + k-1);
+    CodePlane(face, profile, k, codes + (k-1) * plane_codes);
+  }
+  score_t ans = 0;
+  if (!saturated) {
+    score_t last_scores[8];
+    std::copy(face->Cell(I_len, J_len), face->Cell(I_len, J_len) + 8, last_scores);
+    size_t m = BestState(last_scores);
+    size_t i = I_len;
+    size_t j = J_len;
+    ans = last_scores[m];
+    TraceCodes(codes, 0, K_len, k_ini, &i, &j, &m);
+  }
+  return ans;
+}
+
+template<typename SCORE>
+void Phaser::CodePlane(RollingFace<SCORE> * face,
+                       ScoreProfile * profile,
+                       size_t k,
+                       uint8_t * codes) {
+  if (codes == NULL && !use_avx2 && shared_reductions) {
+    SweepPlane<SCORE, CHECKS_OFF>(face, NULL, profile);
+    return;
+  }
+  check_t cell_codes[8];
+  for (size_t j = 0; j <= J_len; j++) {
+    for (size_t i = 0; i <= I_len; i++) {
+      Neighbourhood<SCORE> scores;
+      Neighbourhood<check_t> checks = Neighbourhood<check_t>();
+      face->Roll(i, j, &scores);
+      if (codes == NULL) {
+        UpdateCell<SCORE, false>(&scores, &checks, profile, i, j, k, k);
+        continue;
+      }
+      checks.curr = cell_codes;
+#ifdef __AVX2__
+      if (use_avx2) {
+        UpdateCellAVX2<SCORE, true, true>(&scores, &checks, profile, i, j, k, 0);
+      }
+#endif
+      if (!use_avx2) {
+        checks.back = SOURCES[N_BACK];
+        checks.left = (i > 0) ? SOURCES[N_LEFT] : NULL;
+        checks.back_left = (i > 0) ? SOURCES[N_BACK_LEFT] : NULL;
+        checks.down = (j > 0) ? SOURCES[N_DOWN] : NULL;
+        checks.back_down = (j > 0) ? SOURCES[N_BACK_DOWN] : NULL;
+        checks.back_diag = (i > 0 && j > 0) ? SOURCES[N_BACK_DIAG] : NULL;
+        // With mid_k = 0 < k every state copies the code of its predecessor.
+        UpdateCell<SCORE, true>(&scores, &checks, profile, i, j, k, 0);
+      }
+      uint8_t * ans = codes + 8 * IJ(i, j);
+      for (size_t m = 0; m < 8; m++) {
+        ans[m] = (uint8_t)cell_codes[m];
+      }
+    }
+    face->EndRow();
+  }
+}
+
+void Phaser::TraceCodes(const uint8_t * codes,
+                        size_t k_lo,
+                        size_t k_hi,
+                        size_t k_ini,
+                        size_t * i,
+                        size_t * j,
+                        size_t * m) {
+  size_t plane_codes = 8 * (I_len + 1) * (J_len + 1);
+  size_t k = k_hi;
+  while (k > k_lo) {
+    uint8_t code = codes[(k - k_lo - 1) * plane_codes + 8 * IJ(*i, *j) + *m];
+    size_t n = code >> 3;
+    if (n == N_BACK || n == N_BACK_LEFT || n == N_BACK_DOWN || n == N_BACK_DIAG) {
+      // The path leaves the plane k.
+      char phase_char = (*m >= 4) ? '1' : '0';
+      if (phase_string[k_ini + k-1] != '?') {
+        assert(phase_string[k_ini + k-1] == phase_char);
+      } else {
+        phase_string[k_ini + k-1] = phase_char;
+      }
+      k--;
+    }
+    if (n == N_LEFT || n == N_BACK_LEFT || n == N_BACK_DIAG) {
+      assert(*i > 0);
+      (*i)--;
+    }
+    if (n == N_DOWN || n == N_BACK_DOWN || n == N_BACK_DIAG) {
+      assert(*j > 0);
+      (*j)--;
+    }
+    *m = code & 7;
+  }
+}
+
+template score_t Phaser::FullTraceback<int16_t>(size_t, size_t, size_t, size_t);
+template score_t Phaser::FullTraceback<score_t>(size_t, size_t, size_t, size_t);
+template score_t Phaser::FullTraceback<int16_t>(size_t, size_t, size_t, size_t, RollingFace<int16_t> *,
+                                                ScoreProfile *, uint8_t *);
+template score_t Phaser::FullTraceback<score_t>(size_t, size_t, size_t, size_t, RollingFace<score_t> *,
+                                                ScoreProfile *, uint8_t *);
+// Also used by PhaseMarginals.
+template void Phaser::CodePlane<int16_t>(RollingFace<int16_t> *, ScoreProfile *, size_t, uint8_t *);
+template void Phaser::CodePlane<score_t>(RollingFace<score_t> *, ScoreProfile *, size_t, uint8_t *);
@@ -0,0 +1,253 @@
+/* Copyright (C) 2013, Daniel Valenzuela, all rights reserved.
+ * dvalenzu@cs.helsinki.fi
+ */
+
+// Score-bounded sweep of the k-planes (Phaser::SweepWavefront).
+// ScoreLeft bounds the score of any path from a cell to the last cell of the
+// sub-cube. By default it counts matches: MATCH for each symbol of C and
+// MATCH/2 for each symbol of a parent left, which holds when
+// MISMATCH <= MATCH and 2 * GAP <= MATCH. Then the score a state loses
+// against that count,
+//   MATCH * (2*k + i + j) - 2 * v,
+// is 0 for a path that only matches, and grows with its edits, not with its
+// length. With SetProjectionBounds the bound is the sum of two alignments of
+// C against each parent (ProjectionBound), much closer to the real score.
+//
+// SweepPruned keeps, plane by plane, the box of the cells where some state
+// can still reach min_score (the live cells), like the wavefronts of a
+// Landau-Vishkin alignment. Both bounds are consistent: no step of
+// UpdateGeneral scores more than the bound drops. So every cell of a best
+// path to a live cell is live. A path only moves forward, so plane k starts
+// at the lowest live (i, j) of plane k-1, and it ends where no cell on its
+// upper edge is live. If the last cell is live, every candidate the boxes
+// drop scores less than the best path: the result is the one of the full
+// sweep, ties and checkpoints included. Otherwise SweepWavefront lowers
+// min_score and runs again.
+//
+// Gaps in the parents are copied at no score, and the 8 states may switch at
+// every diagonal step, so a cell does not dominate the ones behind it in the
+// same diagonal: there are no furthest reaching points to slide along, and
+// runs of matches are swept cell by cell in the boxes.
+
+#include "./phaser.h"
+#include <cassert>
+#include <climits>
+#include <algorithm>
+#include "./band_face.h"
+
+// Twice the upper bounds of the score left from the cells of a sub-cube:
+// the part of C against M plus the part of C against F.
+class ScoreLeft {
+ public:
+  ScoreLeft(size_t _I_len, size_t _J_len, size_t _K_len)
+      : I_len(_I_len), J_len(_J_len),
+        m_part((_I_len + 1) * (_K_len + 1)), f_part((_J_len + 1) * (_K_len + 1)) {
+  }
+
+  inline score_t Twice(size_t i, size_t j, size_t k) {
+    return m_part[k * (I_len + 1) + i] + f_part[k * (J_len + 1) + j];
+  }
+
+  // The cell (i, j, k) may still reach min_score.
+  inline bool Live(const score_t * cell_scores, size_t i, size_t j, size_t k, score_t min_score) {
+    score_t best = *std::max_element(cell_scores, cell_scores + 8);
+    return 2 * best + Twice(i, j, k) >= min_score;
+  }
+
+  size_t I_len, J_len;
+  std::vector<score_t> m_part, f_part;
+};
+
+bool Phaser::SweepWavefront(size_t i_ini,
+                            size_t j_ini,
+                            size_t k_ini,
+                            size_t K_len,
+                            size_t mid_k,
+                            score_t * last_scores,
+                            size_t * last_i,
+                            size_t * last_j) {
+  if ((!wavefront && !projection_bounds) || ScoreBound(K_len) >= (size_t)(INT_MAX / 4)) {
+    return false;
+  }
+  ScoreLeft left(I_len, J_len, K_len);
+  if (projection_bounds) {
+    ProjectionBound(M_code, M1, M2, i_ini, I_len, k_ini, K_len, &left.m_part);
+    ProjectionBound(F_code, F1, F2, j_ini, J_len, k_ini, K_len, &left.f_part);
+    for (size_t x = 0; x < left.m_part.size(); x++) {
+      left.m_part[x] *= 2;
+    }
+    for (size_t x = 0; x < left.f_part.size(); x++) {
+      left.f_part[x] *= 2;
+    }
+  } else {
+    // Otherwise some steps score more than the matches they consume.
+    if (SCORE_MATCH <= 0 || SCORE_MISMATCH > SCORE_MATCH || 2 * SCORE_GAP > SCORE_MATCH) {
+      return false;
+    }
+    for (size_t k = 0; k <= K_len; k++) {
+      for (size_t i = 0; i <= I_len; i++) {
+        left.m_part[k * (I_len + 1) + i] = SCORE_MATCH * static_cast<score_t>(K_len - k + I_len - i);
+      }
+      for (size_t j = 0; j <= J_len; j++) {
+        left.f_part[k * (J_len + 1) + j] = SCORE_MATCH * static_cast<score_t>(K_len - k + J_len - j);
+      }
+    }
+  }
+  score_t unit = std::max(std::abs(SCORE_MATCH), std::max(std::abs(SCORE_GAP), std::abs(SCORE_MISMATCH)));
+  for (score_t slack = 16 * std::max(unit, 1); ; slack *= 2) {
+    bool too_wide = false;
+    if (SweepPruned(i_ini, j_ini, k_ini, K_len, mid_k, &left, left.Twice(0, 0, 0) - slack,
+                    last_scores, last_i, last_j, &too_wide)) {
+      return true;
+    }
+    if (too_wide || slack > INT_MAX / 4) {
+      return false;
+    }
+  }
+}
+
+void Phaser::ProjectionBound(code_t * const * P_code,
+                             char * P1,
+                             char * P2,
+                             size_t p_ini,
+                             size_t P_len,
+                             size_t k_ini,
+                             size_t K_len,
+                             std::vector<score_t> * bound) {
+  size_t row = P_len + 1;
+  std::vector<score_t> & ans = *bound;
+  ans[K_len * row + P_len] = 0;
+  for (size_t k = K_len + 1; k-- > 0;) {
+    // C gets a gap: the best of both symbols.
+    score_t c_del = (k < K_len) ?
+        std::max(score(C_code[0][k_ini + k], CODE_GAP), score(C_code[1][k_ini + k], CODE_GAP)) : 0;
+    for (size_t p = P_len + 1; p-- > 0;) {
+      if (k == K_len && p == P_len) {
+        continue;
+      }
+      score_t best = INT_MIN / 4;
+      if (p < P_len) {
+        // The parent gets a gap, or copies one of its own at no score.
+        score_t p_del = INT_MIN / 4;
+        for (bool x : {false, true}) {
+          code_t p_code = P_code[x][p_ini + p];
+          p_del = std::max(p_del, (p_code == CODE_GAP) ? 0 : score(p_code, CODE_GAP));
+        }
+        best = std::max(best, p_del + ans[k * row + p+1]);
+      }
+      if (k < K_len) {
+        best = std::max(best, c_del + ans[(k+1) * row + p]);
+      }
+      if (p < P_len && k < K_len) {
+        score_t align = INT_MIN / 4;
+        for (bool x : {false, true}) {
+          char * P = x ? P2 : P1;
+          for (bool cf : {false, true}) {
+            char * C = cf ? C2 : C1;
+            align = std::max(align, score(C_code[cf][k_ini + k], P_code[x][p_ini + p],
+                                          C[k_ini + k], P[p_ini + p]));
+          }
+        }
+        best = std::max(best, align + ans[(k+1) * row + p+1]);
+      }
+      ans[k * row + p] = best;
+    }
+  }
+}
+
+bool Phaser::SweepPruned(size_t i_ini,
+                         size_t j_ini,
+                         size_t k_ini,
+                         size_t K_len,
+                         size_t mid_k,
+                         ScoreLeft * left,
+                         score_t min_score,
+                         score_t * last_scores,
+                         size_t * last_i,
+                         size_t * last_j,
+                         bool * too_wide) {
+  // Beyond this, the full sweep is about as fast.
+  size_t max_cells = (I_len+1) * (J_len+1) / 4;
+  assert(max_cells <= (size_t)UINT32_MAX);
+  BandFace prev_face(64);
+  BandFace curr_face(64);
+  ScoreProfile profile(I_len, J_len);
+  InitProfile(&profile, i_ini, j_ini);
+
+  // Box of the live cells of the previous plane.
+  size_t live_i_lo = 0;
+  size_t live_i_hi = 0;
+  size_t live_j_lo = 0;
+  size_t live_j_hi = 0;
+  // Cells added after live_i_hi + 1 and live_j_hi + 1.
+  size_t growth = 1;
+  size_t mid_i_lo = 0;
+  size_t mid_j_lo = 0;
+  size_t mid_row = 1;
+  *too_wide = false;
+  for (size_t k = 0; k <= K_len; k++) {
+    bool edge = true;
+    bool any_live = false;
+    while (edge) {
+      size_t i_hi = std::min(I_len, (k > 0 ? live_i_hi + 1 : 0) + growth);
+      size_t j_hi = std::min(J_len, (k > 0 ? live_j_hi + 1 : 0) + growth);
+      curr_face.SetBox(live_i_lo, i_hi, live_j_lo, j_hi);
+      if (curr_face.Cells() > max_cells) {
+        *too_wide = true;
+        return false;
+      }
+      BandPlane(&curr_face, &prev_face, &profile, i_ini, j_ini, k_ini, k, mid_k);
+
+      // A live cell on the upper edge may have live neighbours out of the box.
+      edge = false;
+      any_live = false;
+      size_t next_i_lo = i_hi;
+      size_t next_i_hi = 0;
+      size_t next_j_lo = j_hi;
+      size_t next_j_hi = 0;
+      for (size_t j = curr_face.j_lo; j <= j_hi; j++) {
+        for (size_t i = curr_face.i_lo; i <= i_hi; i++) {
+          if (!left->Live(curr_face.Scores(i, j), i, j, k, min_score)) {
+            continue;
+          }
+          any_live = true;
+          next_i_lo = std::min(next_i_lo, i);
+          next_i_hi = std::max(next_i_hi, i);
+          next_j_lo = std::min(next_j_lo, j);
+          next_j_hi = std::max(next_j_hi, j);
+          edge = edge || (i == i_hi && i_hi < I_len) || (j == j_hi && j_hi < J_len);
+        }
+      }
+      if (edge) {
+        growth *= 2;
+      } else if (any_live) {
+        live_i_lo = next_i_lo;
+        live_i_hi = next_i_hi;
+        live_j_lo = next_j_lo;
+        live_j_hi = next_j_hi;
+      }
+    }
+    if (!any_live) {
+      return false;
+    }
+    if (k == mid_k) {
+      mid_i_lo = curr_face.i_lo;
+      mid_j_lo = curr_face.j_lo;
+      mid_row = curr_face.i_hi - curr_face.i_lo + 1;
+    }
+    prev_face.Swap(&curr_face);
+  }
+
+  if (!prev_face.Inside(I_len, J_len) ||
+      !left->Live(prev_face.Scores(I_len, J_len), I_len, J_len, K_len, min_score)) {
+    return false;
+  }
+  score_t * cell_scores = prev_face.Scores(I_len, J_len);
+  check_t * cell_checks = prev_face.Checks(I_len, J_len);
+  for (size_t m = 0; m < 8; m++) {
+    last_scores[m] = cell_scores[m];
+    last_i[m] = mid_i_lo + cell_checks[m] % mid_row;
+    last_j[m] = mid_j_lo + cell_checks[m] / mid_row;
+  }
+  return true;
+}
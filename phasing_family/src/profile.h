@@ -0,0 +1,97 @@
+/* Copyright (C) 2013, Daniel Valenzuela, all rights reserved.
+ * dvalenzu@cs.helsinki.fi
+ */
+
+#ifndef SRC_PROFILE_H_
+#define SRC_PROFILE_H_
+
+#include <cstdlib>
+#include <algorithm>
+#include "./basic.h"
+
+// Arrays are padded on both sides, so vector loads around any
+// valid position stay inside the buffer.
+const size_t PROFILE_PAD = 16;
+
+// Score terms of a sub-cube, one entry per position of the parents
+// (a "query profile"). The M terms are indexed by i and the F terms by j;
+// entry 0 corresponds to the boundary and holds zeros.
+// The terms that do not depend on k are written by Phaser::InitProfile,
+// the rest by Phaser::FillProfile once per plane, so the kernels do plain
+// loads instead of calling Phaser::score for every cell.
+// c_1 is the child haplotype aligned to M (C1 if cf == 0, C2 if cf == 1)
+// and c_2 the one aligned to F.
+struct ScoreProfile {
+  ScoreProfile(size_t I_len, size_t J_len)
+      : buffer(new score_t[BufferSize(I_len, J_len)]()), owner(true) {
+    Carve(I_len, J_len);
+  }
+
+  // Over the BufferSize(I_len, J_len) entries of _buffer, which the caller
+  // keeps.
+  ScoreProfile(size_t I_len, size_t J_len, score_t * _buffer)
+      : buffer(_buffer), owner(false) {
+    std::fill(buffer, buffer + BufferSize(I_len, J_len), 0);
+    Carve(I_len, J_len);
+  }
+
+  static inline size_t BufferSize(size_t I_len, size_t J_len) {
+    return 9 * (I_len + 1 + 2 * PROFILE_PAD) + 9 * (J_len + 1 + 2 * PROFILE_PAD);
+  }
+
+  ~ScoreProfile() {
+    if (owner) {
+      delete[] buffer;
+    }
+  }
+
+  score_t * m_ins[2];         // [mf]: score(M_mf[i-1], '-')
+  score_t * m_gap[2];         // [mf]: -1 if M_mf[i-1] is a gap, 0 otherwise
+  score_t * m_align[2][2];    // [cf][mf]: score(c_1, M_mf[i-1])
+  score_t * m_same;           // -1 if M_0[i-1] and M_1[i-1] are the same symbol
+  score_t * f_ins[2];         // [ff]: score(F_ff[j-1], '-')
+  score_t * f_gap[2];         // [ff]: -1 if F_ff[j-1] is a gap, 0 otherwise
+  score_t * f_align[2][2];    // [cf][ff]: score(c_2, F_ff[j-1])
+  score_t * f_same;           // -1 if F_0[j-1] and F_1[j-1] are the same symbol
+  score_t c_del;              // score(c_1, '-') + score(c_2, '-')
+  score_t m_del[2];           // [cf]: score(c_2, '-')
+  score_t f_del[2];           // [cf]: score(c_1, '-')
+  bool c_same;                // C_0[k] and C_1[k] are the same symbol
+
+ private:
+  void Carve(size_t I_len, size_t J_len) {
+    size_t m_size = I_len + 1 + 2 * PROFILE_PAD;
+    size_t f_size = J_len + 1 + 2 * PROFILE_PAD;
+    score_t * next = buffer + PROFILE_PAD;
+    for (size_t x = 0; x < 2; x++) {
+      m_ins[x] = next;
+      m_gap[x] = next + m_size;
+      m_align[0][x] = next + 2 * m_size;
+      m_align[1][x] = next + 3 * m_size;
+      next += 4 * m_size;
+    }
+    m_same = next;
+    next += m_size;
+    for (size_t x = 0; x < 2; x++) {
+      f_ins[x] = next;
+      f_gap[x] = next + f_size;
+      f_align[0][x] = next + 2 * f_size;
+      f_align[1][x] = next + 3 * f_size;
+      next += 4 * f_size;
+    }
+    f_same = next;
+    next += f_size;
+    c_del = 0;
+    m_del[0] = m_del[1] = 0;
+    f_del[0] = f_del[1] = 0;
+    c_same = false;
+  }
+
+  score_t * buffer;
+  bool owner;
+
+  ScoreProfile(const ScoreProfile &);
+  ScoreProfile & operator=(const ScoreProfile &);
+};
+
+#endif  // SRC_PROFILE_H_
@@ -0,0 +1,77 @@
+/* Copyright (C) 2013, Daniel Valenzuela, all rights reserved.
+ * dvalenzu@cs.helsinki.fi
+ */
+
+#ifndef SRC_SCHEME_PROFILE_H_
+#define SRC_SCHEME_PROFILE_H_
+
+#include <cstdlib>
+#include "./basic.h"
+
+// Scoring schemes swept at once by Phaser::similarity_and_consensus_schemes,
+// one per lane: 8 score_t fill an AVX2 vector.
+const size_t SCHEME_LANES = 8;
+
+// Default of Phaser::SetSchemeBudget.
+const size_t SCHEME_BUDGET = (size_t)1 << 30;
+
+struct ScoringScheme {
+  score_t gap;
+  score_t mismatch;
+  score_t match;
+};
+
+// One score per scheme, one AVX2 vector in the kernels of
+// phaser_schemes.cpp.
+struct SchemeLanes {
+  score_t v[SCHEME_LANES];
+};
+
+// ScoreProfile with one lane per scheme. The gap flags are the same for
+// every scheme; only the terms that ScoreProfile reads from pair_scores have
+// lanes.
+struct SchemeProfile {
+  SchemeProfile(size_t I_len, size_t J_len)
+      : buffer(new SchemeLanes[8 * (I_len + 1) + 8 * (J_len + 1)]),
+        gaps(new bool[2 * (I_len + 1) + 2 * (J_len + 1)]) {
+    SchemeLanes * next = buffer;
+    for (size_t x = 0; x < 2; x++) {
+      m_ins[x] = next;
+      m_align[0][x] = next + (I_len + 1);
+      m_align[1][x] = next + 2 * (I_len + 1);
+      next += 3 * (I_len + 1);
+      m_gap[x] = gaps + x * (I_len + 1);
+    }
+    for (size_t x = 0; x < 2; x++) {
+      f_ins[x] = next;
+      f_align[0][x] = next + (J_len + 1);
+      f_align[1][x] = next + 2 * (J_len + 1);
+      next += 3 * (J_len + 1);
+      f_gap[x] = gaps + 2 * (I_len + 1) + x * (J_len + 1);
+    }
+  }
+
+  ~SchemeProfile() {
+    delete[] buffer;
+    delete[] gaps;
+  }
+
+  SchemeLanes * m_ins[2];         // [mf]: score(M_mf[i-1], '-')
+  bool * m_gap[2];                // [mf]: M_mf[i-1] is a gap
+  SchemeLanes * m_align[2][2];    // [cf][mf]: score(c_1, M_mf[i-1])
+  SchemeLanes * f_ins[2];         // [ff]: score(F_ff[j-1], '-')
+  bool * f_gap[2];                // [ff]: F_ff[j-1] is a gap
+  SchemeLanes * f_align[2][2];    // [cf][ff]: score(c_2, F_ff[j-1])
+  SchemeLanes c_del;              // score(c_1, '-') + score(c_2, '-')
+  SchemeLanes m_del[2];           // [cf]: score(c_2, '-')
+  SchemeLanes f_del[2];           // [cf]: score(c_1, '-')
+
+ private:
+  SchemeLanes * buffer;
+  bool * gaps;
+
+  SchemeProfile(const SchemeProfile &);
+  SchemeProfile & operator=(const SchemeProfile &);
+};
+
+#endif  // SRC_SCHEME_PROFILE_H_
@@ -0,0 +1,88 @@
+/* Copyright (C) 2013, Daniel Valenzuela, all rights reserved.
+ * dvalenzu@cs.helsinki.fi
+ */
+
+// Small AVX2 helpers shared by the vectorized kernels.
+// Vectors hold 8 32 bits lanes (score_t or check_t).
+
+#ifndef SRC_SIMD_H_
+#define SRC_SIMD_H_
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#include "./basic.h"
+
+static inline __m256i Load(const int * ptr) {
+  return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ptr));
+}
+
+static inline void Store(int * ptr, __m256i val) {
+  _mm256_storeu_si256(reinterpret_cast<__m256i *>(ptr), val);
+}
+
+static inline __m256i Load(const uint32_t * ptr) {
+  return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ptr));
+}
+
+static inline void Store(uint32_t * ptr, __m256i val) {
+  _mm256_storeu_si256(reinterpret_cast<__m256i *>(ptr), val);
+}
+
+// Scores stored as int16_t are widened to 8 int32 lanes on load and
+// narrowed back on store, flagging the lanes that do not fit.
+static inline __m256i LoadScores(const int * ptr) {
+  return Load(ptr);
+}
+
+static inline __m256i LoadScores(const int16_t * ptr) {
+  return _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(ptr)));
+}
+
+static inline void StoreScores(int * ptr, __m256i val, bool * /* saturated */) {
+  Store(ptr, val);
+}
+
+static inline void StoreScores(int16_t * ptr, __m256i val, bool * saturated) {
+  __m128i packed = _mm_packs_epi32(_mm256_castsi256_si128(val), _mm256_extracti128_si256(val, 1));
+  __m256i widened = _mm256_cvtepi16_epi32(packed);
+  *saturated |= (_mm256_movemask_epi8(_mm256_cmpeq_epi32(widened, val)) != -1);
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(ptr), packed);
+}
+
+static inline __m256i Lanes(int l0, int l1, int l2, int l3,
+                            int l4, int l5, int l6, int l7) {
+  return _mm256_setr_epi32(l0, l1, l2, l3, l4, l5, l6, l7);
+}
+
+// Same rule as Phaser::UpdateVals: a candidate replaces the current
+// maximum only if it is strictly larger.
+static inline void UpdateValsAVX2(__m256i candidate,
+                                  __m256i candidate_src,
+                                  __m256i * max,
+                                  __m256i * max_src) {
+  __m256i greater = _mm256_cmpgt_epi32(candidate, *max);
+  *max = _mm256_blendv_epi8(*max, candidate, greater);
+  *max_src = _mm256_blendv_epi8(*max_src, candidate_src, greater);
+}
+
+// As UpdateValsAVX2, only for the lanes set in valid.
+static inline void UpdateValsAVX2(__m256i candidate,
+                                  __m256i candidate_src,
+                                  __m256i valid,
+                                  __m256i * max,
+                                  __m256i * max_src) {
+  __m256i greater = _mm256_and_si256(_mm256_cmpgt_epi32(candidate, *max), valid);
+  *max = _mm256_blendv_epi8(*max, candidate, greater);
+  *max_src = _mm256_blendv_epi8(*max_src, candidate_src, greater);
+}
+
+// Maximum over the 8 lanes, broadcast to all of them.
+static inline __m256i HorizontalMax(__m256i v) {
+  __m256i max = _mm256_max_epi32(v, _mm256_permute2x128_si256(v, v, 1));
+  max = _mm256_max_epi32(max, _mm256_shuffle_epi32(max, _MM_SHUFFLE(1, 0, 3, 2)));
+  max = _mm256_max_epi32(max, _mm256_shuffle_epi32(max, _MM_SHUFFLE(2, 3, 0, 1)));
+  return max;
+}
+
+#endif  // __AVX2__
+#endif  // SRC_SIMD_H_
@@ -17,6 +17,8 @@ using std::setfill;
 score_t SCORE_GAP = -1;
 score_t SCORE_MISMATCH = -1;
 score_t SCORE_MATCH = 1;
+// Megabytes each phasing may spend on TRACEBACK_FULL, see SetMemoryBudget.
+size_t MEMORY_BUDGET_MB = 64;
 
 bool verbose = false;
 void Sensibility(char * sequence, size_t seq_len, int n_repeats);
@@ -62,7 +64,7 @@ void PrintDataFile(size_t length,
 void printUssage();
 void printUssage() {
   fprintf(stderr, "Ussage:\n");
-  fprintf(stderr, "./phase_synthetic_trio seed.fa length n_repeats\n");
+  fprintf(stderr, "./phase_synthetic_trio seed.fa length n_repeats [memory_mb]\n");
 }
 
 int main(int argc, char ** argv) {
@@ -70,10 +72,13 @@ int main(int argc, char ** argv) {
   assert(SCORE_MISMATCH <= SCORE_GAP);
   // prefer mismatch over two gaps:
   assert(2*SCORE_GAP <= SCORE_MISMATCH);
-  if (argc != 4) {
+  if (argc != 4 && argc != 5) {
     printUssage();
     return EXIT_FAILURE;
   }
+  if (argc == 5) {
+    MEMORY_BUDGET_MB = (size_t)atol(argv[4]);
+  }
   char* file_name = argv[1];
   size_t length = (size_t)atol(argv[2]);
   int n_repeats = atol(argv[3]);
@@ -259,6 +264,7 @@ void Experiment(char * sequence,
     phaser->SetScoreGap(SCORE_GAP);
     phaser->SetScoreMismatch(SCORE_MISMATCH);
     phaser->SetScoreMatch(SCORE_MATCH);
+    phaser->SetMemoryBudget(MEMORY_BUDGET_MB << 20);
     Utils::StartClock();
     score_t score = phaser->similarity_and_phase();
     double time = Utils::StopClock();
@@ -40,6 +40,8 @@ void Fail();
 void Success();
 void Summary();
 
+void TestEncodedScores();
+
 void TestPhaserShortK_A();
 void TestPhaserShortK_B();
 void TestPhaserShortK_C();
@@ -100,6 +102,41 @@ void TestPhaserChildGapped_C();
 void TestPhaserExhaustiveVarLength();
 void TestPhaserExhaustiveSameLength();
 
+void TestPhaserAVX2VsScalar();
+void TestPhaserAVX2Recomb();
+void TestPhaserDiagonalsVsRows();
+void TestPhaserDiagonalsDeletion();
+void TestPhaserNarrowScores();
+void TestPhaserNarrowSaturated();
+void TestPhaserDeltasVsRows();
+void TestPhaserDeltasMismatchIndel();
+void TestPhaserScoreOnly();
+void TestPhaserScoreOnlyRecomb();
+void TestPhaserBanded();
+void TestPhaserBandCutsOptimum();
+void TestPhaserWavefront();
+void TestPhaserWavefrontMismatch();
+void TestPhaserProjectionBounds();
+void TestPhaserProjectionInsertion();
+void TestPhaserSharedVsGeneral();
+void TestPhaserSharedSwitches();
+void TestPhaserTraceback();
+void TestPhaserTracebackSwitch();
+void TestPhaserSmallProblem();
+void TestPhaserSmallChildGap();
+void TestPhaserGapRuns();
+void TestPhaserGapRunMother();
+void TestCompactTrio();
+void TestCompactInsertion();
+void TestPhaserHomozygousCollapse();
+void TestPhaserHomozygousStretch();
+void TestPhaserConsensus();
+void TestPhaserConsensusTie();
+void TestPhaserMargins();
+void TestPhaserMarginsTie();
+void TestPhaserSchemes();
+void TestPhaserSchemesTie();
+
 void TestFasta();
 
 
@@ -126,6 +163,116 @@ bool equalPhases(char * p1, char * p2, size_t len) {
   return true;
 }
 
+// Random inputs used to cross-check the different kernels against
+// the reference one.
+struct Trio {
+  char * M1;
+  char * M2;
+  size_t M_len;
+  char * F1;
+  char * F2;
+  size_t F_len;
+  char * C1;
+  char * C2;
+  size_t C_len;
+};
+char * RandomVariant(char * seed, size_t len, double mutation_ratio, double gap_ratio);
+void RandomTrio(size_t max_len, Trio * trio);
+void CloseTrio(size_t len, Trio * trio);
+void DeleteTrio(Trio * trio);
+Phaser * NewPhaser(Trio * trio);
+bool SamePhasing(Phaser * reference, Phaser * other, Trio * trio, bool phase);
+
+char * RandomVariant(char * seed, size_t len, double mutation_ratio, double gap_ratio) {
+  const char * alphabet = "ACGT";
+  char * ans = new char[len];
+  for (size_t i = 0; i < len; i++) {
+    ans[i] = seed[i];
+    if (rand() < mutation_ratio * RAND_MAX)
+      ans[i] = alphabet[rand()%4];
+    if (rand() < gap_ratio * RAND_MAX)
+      ans[i] = '-';
+  }
+  return ans;
+}
+
+void RandomTrio(size_t max_len, Trio * trio) {
+  const char * alphabet = "ACGT";
+  char * seed = new char[max_len];
+  for (size_t i = 0; i < max_len; i++)
+    seed[i] = alphabet[rand()%4];
+  double mutation_ratio = 0.1 * (rand()%4);
+  double gap_ratio = 0.1 * (rand()%3);
+  trio->M_len = 1 + (size_t)rand() % max_len;
+  trio->F_len = 1 + (size_t)rand() % max_len;
+  trio->C_len = 1 + (size_t)rand() % max_len;
+  trio->M1 = RandomVariant(seed, trio->M_len, mutation_ratio, gap_ratio);
+  trio->M2 = RandomVariant(seed, trio->M_len, mutation_ratio, gap_ratio);
+  trio->F1 = RandomVariant(seed, trio->F_len, mutation_ratio, gap_ratio);
+  trio->F2 = RandomVariant(seed, trio->F_len, mutation_ratio, gap_ratio);
+  trio->C1 = RandomVariant(seed, trio->C_len, mutation_ratio, gap_ratio);
+  trio->C2 = RandomVariant(seed, trio->C_len, mutation_ratio, gap_ratio);
+  delete[] seed;
+}
+
+// Six haplotypes of the same length, with few differences.
+void CloseTrio(size_t len, Trio * trio) {
+  const char * alphabet = "ACGT";
+  char * seed = new char[len];
+  for (size_t i = 0; i < len; i++)
+    seed[i] = alphabet[rand()%4];
+  double mutation_ratio = 0.01 * (rand()%4);
+  double gap_ratio = 0.01 * (rand()%3);
+  trio->M_len = trio->F_len = trio->C_len = len;
+  trio->M1 = RandomVariant(seed, len, mutation_ratio, gap_ratio);
+  trio->M2 = RandomVariant(seed, len, mutation_ratio, gap_ratio);
+  trio->F1 = RandomVariant(seed, len, mutation_ratio, gap_ratio);
+  trio->F2 = RandomVariant(seed, len, mutation_ratio, gap_ratio);
+  trio->C1 = RandomVariant(seed, len, mutation_ratio, gap_ratio);
+  trio->C2 = RandomVariant(seed, len, mutation_ratio, gap_ratio);
+  delete[] seed;
+}
+
+void DeleteTrio(Trio * trio) {
+  delete[] trio->M1;
+  delete[] trio->M2;
+  delete[] trio->F1;
+  delete[] trio->F2;
+  delete[] trio->C1;
+  delete[] trio->C2;
+}
+
+Phaser * NewPhaser(Trio * trio) {
+  Phaser * ans =  new Phaser(trio->M1, trio->M2, trio->M_len,
+                             trio->F1, trio->F2, trio->F_len,
+                             trio->C1, trio->C2, trio->C_len);
+  ans->SetScoreGap(SCORE_GAP);
+  ans->SetScoreMismatch(SCORE_MISMATCH);
+  ans->SetScoreMatch(SCORE_MATCH);
+  return ans;
+}
+
+// Runs both phasers on the trio, expecting the same score
+// and (if phase is set) the same phase string.
+bool SamePhasing(Phaser * reference, Phaser * other, Trio * trio, bool phase) {
+  score_t expected = phase ? reference->similarity_and_phase() : reference->similarity();
+  score_t score = phase ? other->similarity_and_phase() : other->similarity();
+  if (score != expected) {
+    printf("Wrong score: %i instead of %i\n", score, expected);
+  } else if (!phase || equalPhases(reference->GetPhaseString(), other->GetPhaseString(), trio->C_len)) {
+    return true;
+  }
+  Debug::PrintArray(trio->M1, trio->M_len);
+  Debug::PrintArray(trio->M2, trio->M_len);
+  Debug::PrintLine(trio->C_len);
+  Debug::PrintArray(trio->F1, trio->F_len);
+  Debug::PrintArray(trio->F2, trio->F_len);
+  Debug::PrintLine(trio->C_len);
+  Debug::PrintArray(trio->C1, trio->C_len);
+  Debug::PrintArray(trio->C2, trio->C_len);
+  return false;
+}
+
 void Summary() {
   if (!global_fail) {
     printf(ANSI_COLOR_GREEN "\n\t%i TEST RUN\n" ANSI_COLOR_RESET, global_success_count);
@@ -160,6 +307,43 @@ void TestFasta() {
   Success();
 }
 
+// The table driven score must agree with plain char comparisons.
+void TestEncodedScores() {
+  printf("Running TestEncodedScores:\n");
+  const char symbols[] = "ACGTN-XYa18";
+  size_t n_symbols = sizeof(symbols) - 1;
+  char seq[1] = {'A'};
+  Phaser * tmp =  new Phaser(seq, seq, 1,
+                             seq, seq, 1,
+                             seq, seq, 1);
+  tmp->SetScoreGap(SCORE_GAP);
+  tmp->SetScoreMismatch(SCORE_MISMATCH);
+  tmp->SetScoreMatch(SCORE_MATCH);
+  for (size_t x = 0; x < n_symbols; x++) {
+    for (size_t y = 0; y < n_symbols; y++) {
+      char a = symbols[x];
+      char b = symbols[y];
+      score_t expected;
+      if (a == '-' && b == '-') {
+        expected = 0;
+      } else if (a == b) {
+        expected = SCORE_MATCH;
+      } else if (a == '-' || b == '-') {
+        expected = SCORE_GAP;
+      } else {
+        expected = SCORE_MISMATCH;
+      }
+      if (tmp->score(Encode(a), Encode(b), a, b) != expected) {
+        delete(tmp);
+        Fail();
+        return;
+      }
+    }
+  }
+  delete(tmp);
+  Success();
+}
+
 ////// thoe were for dev / test.
 void TestPhaserShortK_A() {
   printf("Running TestPhaserShortK_A:\n");
@@ -2137,6 +2321,1421 @@ void TestPhaserExhaustiveVarLength() {
   Success();
 }
 
+void TestPhaserAVX2VsScalar() {
+  printf("Running TestPhaserAVX2VsScalar:\n");
+  size_t max_len = 30;
+  size_t n_repeats = 100;
+  for (size_t r = 0; r < n_repeats; r++) {
+    Trio trio;
+    RandomTrio(max_len, &trio);
+    Phaser * scalar = NewPhaser(&trio);
+    Phaser * simd = NewPhaser(&trio);
+    scalar->SetAVX2(false);
+    simd->SetAVX2(true);
+    bool ok = SamePhasing(scalar, simd, &trio, true);
+    delete(scalar);
+    delete(simd);
+    DeleteTrio(&trio);
+    if (!ok) {
+      Fail();
+      return;
+    }
+  }
+  Success();
+}
+
+// Both parents recombine and the child switches phase after column 1, so
+// the kernels switch every state of the cell. The four parents differ at
+// every column.
+void TestPhaserAVX2Recomb() {
+  printf("Running TestPhaserAVX2Recomb:\n");
+  char M1[4] = {'A', 'C', 'G', 'T'};
+  char M2[4] = {'C', 'A', 'T', 'G'};
+  size_t M_len = 4;
+
+  char F1[4] = {'G', 'T', 'A', 'C'};
+  char F2[4] = {'T', 'G', 'C', 'A'};
+  size_t F_len = 4;
+
+  // C1 from M1 M2 F2 F1, C2 from F1 F2 M1 M2.
+  char C1[4] = {'A', 'A', 'C', 'C'};
+  char C2[4] = {'G', 'G', 'G', 'G'};
+  char phase_real[4] = {'0', '0', '1', '1'};
+  size_t C_len = 4;
+  // Every symbol matches.
+  for (bool avx2 : {false, true}) {
+    Phaser * tmp =  new Phaser(M1, M2, M_len,
+                               F1, F2, F_len,
+                               C1, C2, C_len);
+    tmp->SetScoreGap(SCORE_GAP);
+    tmp->SetScoreMismatch(SCORE_MISMATCH);
+    tmp->SetScoreMatch(SCORE_MATCH);
+    tmp->SetAVX2(avx2);
+    score_t score = tmp->similarity_and_phase();
+    char * phase_algor = tmp->GetPhaseString();
+    if (score != 2*((int)C_len)*SCORE_MATCH) {
+      Fail();
+      return;
+    }
+    if (!equalPhases(phase_real, phase_algor, C_len)) {
+      Fail();
+      return;
+    }
+    delete(tmp);
+  }
+  Success();
+}
+
+void TestPhaserDiagonalsVsRows() {
+  printf("Running TestPhaserDiagonalsVsRows:\n");
+  size_t max_len = 60;
+  size_t n_repeats = 100;
+  for (size_t r = 0; r < n_repeats; r++) {
+    Trio trio;
+    RandomTrio(max_len, &trio);
+    Phaser * rows = NewPhaser(&trio);
+    Phaser * diagonals = NewPhaser(&trio);
+    rows->SetAVX2(false);
+    diagonals->SetSweep(SWEEP_DIAGONALS);
+    bool ok = SamePhasing(rows, diagonals, &trio, true);
+    delete(rows);
+    delete(diagonals);
+    DeleteTrio(&trio);
+    if (!ok) {
+      Fail();
+      return;
+    }
+  }
+  Success();
+}
+
+// M has one symbol more than C, so the diagonals of each plane are not
+// square: C1 skips the T of M1.
+void TestPhaserDiagonalsDeletion() {
+  printf("Running TestPhaserDiagonalsDeletion:\n");
+  char M1[5] = {'A', 'A', 'T', 'A', 'A'};
+  char M2[5] = {'C', 'C', 'C', 'C', 'C'};
+  size_t M_len = 5;
+
+  char F1[4] = {'G', 'G', 'G', 'G'};
+  char F2[4] = {'T', 'T', 'T', 'T'};
+  size_t F_len = 4;
+
+  char C1[4] = {'A', 'A', 'A', 'A'};
+  char C2[4] = {'G', 'G', 'G', 'G'};
+  char phase_real[4] = {'0', '0', '0', '0'};
+  size_t C_len = 4;
+  // 8 matches and the deletion of M1[2].
+  score_t expected = 2*((int)C_len)*SCORE_MATCH + SCORE_GAP;
+  for (sweep_t sweep : {SWEEP_ROWS, SWEEP_DIAGONALS}) {
+    Phaser * tmp =  new Phaser(M1, M2, M_len,
+                               F1, F2, F_len,
+                               C1, C2, C_len);
+    tmp->SetScoreGap(SCORE_GAP);
+    tmp->SetScoreMismatch(SCORE_MISMATCH);
+    tmp->SetScoreMatch(SCORE_MATCH);
+    tmp->SetSweep(sweep);
+    score_t score = tmp->similarity_and_phase();
+    char * phase_algor = tmp->GetPhaseString();
+    if (score != expected) {
+      Fail();
+      return;
+    }
+    if (!equalPhases(phase_real, phase_algor, C_len)) {
+      Fail();
+      return;
+    }
+    delete(tmp);
+  }
+  Success();
+}
+
+// int16_t faces must give the same results as score_t ones. Half of the
+// trios use scores large enough to saturate them, forcing a rerun.
+void TestPhaserNarrowScores() {
+  printf("Running TestPhaserNarrowScores:\n");
+  size_t max_len = 30;
+  size_t n_repeats = 100;
+  for (size_t r = 0; r < n_repeats; r++) {
+    Trio trio;
+    RandomTrio(max_len, &trio);
+    score_t scale = (r % 2) ? 1000 : 1;
+    bool ok = true;
+    for (bool avx2 : {false, true}) {
+      Phaser * wide = NewPhaser(&trio);
+      Phaser * narrow = NewPhaser(&trio);
+      for (Phaser * phaser : {wide, narrow}) {
+        phaser->SetScoreGap(scale * SCORE_GAP);
+        phaser->SetScoreMismatch(scale * SCORE_MISMATCH);
+        phaser->SetScoreMatch(scale * SCORE_MATCH);
+        phaser->SetAVX2(avx2);
+      }
+      wide->SetScoreWidth(WIDTH_32);
+      narrow->SetScoreWidth(WIDTH_16);
+      ok = ok && SamePhasing(wide, narrow, &trio, true);
+      delete(wide);
+      delete(narrow);
+    }
+    DeleteTrio(&trio);
+    if (!ok) {
+      Fail();
+      return;
+    }
+  }
+  Success();
+}
+
+// Scores a thousand times the usual ones saturate int16_t faces: the
+// narrow sweep must rerun wide and give the same answer.
+void TestPhaserNarrowSaturated() {
+  printf("Running TestPhaserNarrowSaturated:\n");
+  char M1[4] = {'A', 'A', 'A', 'A'};
+  char M2[4] = {'C', 'C', 'C', 'C'};
+  size_t M_len = 4;
+
+  char F1[4] = {'G', 'G', 'G', 'G'};
+  char F2[4] = {'T', 'T', 'T', 'T'};
+  size_t F_len = 4;
+
+  char C1[4] =        {'N', 'A', 'A', 'A'};
+  char C2[4] =        {'G', 'G', 'G', 'G'};
+  char phase_real[4] = {'0', '0', '0', '0'};
+  size_t C_len = 4;
+  // 7 matches and 1 mismatch.
+  score_t scale = 1000;
+  score_t expected = scale * (7*SCORE_MATCH + SCORE_MISMATCH);
+  for (bool avx2 : {false, true}) {
+    for (score_width_t width : {WIDTH_16, WIDTH_32}) {
+      Phaser * tmp =  new Phaser(M1, M2, M_len,
+                                 F1, F2, F_len,
+                                 C1, C2, C_len);
+      tmp->SetScoreGap(scale * SCORE_GAP);
+      tmp->SetScoreMismatch(scale * SCORE_MISMATCH);
+      tmp->SetScoreMatch(scale * SCORE_MATCH);
+      tmp->SetAVX2(avx2);
+      tmp->SetScoreWidth(width);
+      score_t score = tmp->similarity_and_phase();
+      char * phase_algor = tmp->GetPhaseString();
+      if (score != expected) {
+        Fail();
+        return;
+      }
+      if (!equalPhases(phase_real, phase_algor, C_len)) {
+        Fail();
+        return;
+      }
+      delete(tmp);
+    }
+  }
+  Success();
+}
+
+// Half of the trios use the unit scores of mfc_similarity_phaser, whose
+// differences fit in int8_t. The other half use the scores of this file,
+// too large for SweepDeltas (DeltasFit), so the rows are used instead.
+void TestPhaserDeltasVsRows() {
+  printf("Running TestPhaserDeltasVsRows:\n");
+  size_t max_len = 30;
+  size_t n_repeats = 100;
+  for (size_t r = 0; r < n_repeats; r++) {
+    Trio trio;
+    RandomTrio(max_len, &trio);
+    bool unit = (r % 2 == 0);
+    bool ok = true;
+    for (bool avx2 : {false, true}) {
+      Phaser * rows = NewPhaser(&trio);
+      Phaser * deltas = NewPhaser(&trio);
+      for (Phaser * phaser : {rows, deltas}) {
+        phaser->SetScoreGap(unit ? -1 : SCORE_GAP);
+        phaser->SetScoreMismatch(unit ? -1 : SCORE_MISMATCH);
+        phaser->SetScoreMatch(unit ? 1 : SCORE_MATCH);
+        phaser->SetAVX2(avx2);
+      }
+      rows->SetScoreWidth(WIDTH_32);
+      deltas->SetSweep(SWEEP_DELTAS);
+      ok = ok && SamePhasing(rows, deltas, &trio, true);
+      delete(rows);
+      delete(deltas);
+    }
+    DeleteTrio(&trio);
+    if (!ok) {
+      Fail();
+      return;
+    }
+  }
+  Success();
+}
+
+// A mismatch and a gap in C1. The unit scores of mfc_similarity_phaser are
+// swept with SweepDeltas; the scores of this file do not fit it
+// (DeltasFit), and the rows are used instead.
+void TestPhaserDeltasMismatchIndel() {
+  printf("Running TestPhaserDeltasMismatchIndel:\n");
+  char M1[4] = {'A', 'A', 'A', 'A'};
+  char M2[4] = {'C', 'C', 'C', 'C'};
+  size_t M_len = 4;
+
+  char F1[4] = {'G', 'G', 'G', 'G'};
+  char F2[4] = {'T', 'T', 'T', 'T'};
+  size_t F_len = 4;
+
+  char C1[4] = {'N', '-', 'A', 'A'};
+  char C2[4] = {'G', 'G', 'G', 'G'};
+  char phase_real[4] = {'0', '0', '0', '0'};
+  size_t C_len = 4;
+  // 6 matches, 1 mismatch and 1 deletion.
+  for (bool unit : {true, false}) {
+    score_t gap = unit ? -1 : SCORE_GAP;
+    score_t mismatch = unit ? -1 : SCORE_MISMATCH;
+    score_t match = unit ? 1 : SCORE_MATCH;
+    Phaser * tmp =  new Phaser(M1, M2, M_len,
+                               F1, F2, F_len,
+                               C1, C2, C_len);
+    tmp->SetScoreGap(gap);
+    tmp->SetScoreMismatch(mismatch);
+    tmp->SetScoreMatch(match);
+    tmp->SetSweep(SWEEP_DELTAS);
+    score_t score = tmp->similarity_and_phase();
+    char * phase_algor = tmp->GetPhaseString();
+    score_t expected = (2*(int)C_len - 2)*match + mismatch + gap;
+    if (score != expected) {
+      Fail();
+      return;
+    }
+    if (!equalPhases(phase_real, phase_algor, C_len)) {
+      Fail();
+      return;
+    }
+    delete(tmp);
+  }
+  Success();
+}
+
+// similarity() does not track checkpoints, every engine must still
+// give the score of the full phasing.
+void TestPhaserScoreOnly() {
+  printf("Running TestPhaserScoreOnly:\n");
+  size_t max_len = 30;
+  size_t n_repeats = 100;
+  for (size_t r = 0; r < n_repeats; r++) {
+    Trio trio;
+    RandomTrio(max_len, &trio);
+    Phaser * reference = NewPhaser(&trio);
+    score_t expected = reference->similarity_and_phase();
+    delete(reference);
+    bool ok = true;
+    for (bool avx2 : {false, true}) {
+      for (sweep_t sweep : {SWEEP_ROWS, SWEEP_DIAGONALS, SWEEP_DELTAS}) {
+        for (score_width_t width : {WIDTH_16, WIDTH_32}) {
+          Phaser * phaser = NewPhaser(&trio);
+          phaser->SetAVX2(avx2);
+          phaser->SetSweep(sweep);
+          phaser->SetScoreWidth(width);
+          score_t score = phaser->similarity();
+          if (score != expected) {
+            printf("Wrong score: %i instead of %i\n", score, expected);
+            ok = false;
+          }
+          delete(phaser);
+        }
+      }
+    }
+    DeleteTrio(&trio);
+    if (!ok) {
+      Fail();
+      return;
+    }
+  }
+  Success();
+}
+
+// similarity() of every sweep, on a trio where all of M, F and C switch.
+// The four parents differ at every column.
+void TestPhaserScoreOnlyRecomb() {
+  printf("Running TestPhaserScoreOnlyRecomb:\n");
+  char M1[4] = {'A', 'C', 'G', 'T'};
+  char M2[4] = {'C', 'A', 'T', 'G'};
+  size_t M_len = 4;
+
+  char F1[4] = {'G', 'T', 'A', 'C'};
+  char F2[4] = {'T', 'G', 'C', 'A'};
+  size_t F_len = 4;
+
+  // C1 from M1 M1 F2 F1, C2 from F1 F2 M2 M2.
+  char C1[4] = {'A', 'C', 'C', 'C'};
+  char C2[4] = {'G', 'G', 'T', 'G'};
+  size_t C_len = 4;
+  // Every symbol matches.
+  for (sweep_t sweep : {SWEEP_ROWS, SWEEP_DIAGONALS, SWEEP_DELTAS}) {
+    Phaser * tmp =  new Phaser(M1, M2, M_len,
+                               F1, F2, F_len,
+                               C1, C2, C_len);
+    tmp->SetScoreGap(SCORE_GAP);
+    tmp->SetScoreMismatch(SCORE_MISMATCH);
+    tmp->SetScoreMatch(SCORE_MATCH);
+    tmp->SetSweep(sweep);
+    score_t score = tmp->similarity();
+    if (score != 2*((int)C_len)*SCORE_MATCH) {
+      Fail();
+      return;
+    }
+    delete(tmp);
+  }
+  Success();
+}
+
+void TestPhaserBanded() {
+  printf("Running TestPhaserBanded:\n");
+  size_t max_len = 40;
+  size_t n_repeats = 200;
+  for (size_t r = 0; r < n_repeats; r++) {
+    Trio trio;
+    RandomTrio(max_len, &trio);
+    bool ok = true;
+    size_t bands[2] = {1, 3};
+    for (size_t band : bands) {
+      for (bool phase : {false, true}) {
+        Phaser * full = NewPhaser(&trio);
+        Phaser * banded = NewPhaser(&trio);
+        banded->SetBand(band);
+        ok = ok && SamePhasing(full, banded, &trio, phase);
+        delete(full);
+        delete(banded);
+      }
+    }
+    DeleteTrio(&trio);
+    if (!ok) {
+      Fail();
+      return;
+    }
+  }
+  Success();
+}
+
+// M1 starts with 6 symbols that C1 skips, all in the plane 0. The band of
+// width 1 keeps i <= 2 there and cuts the best path: it must widen.
+void TestPhaserBandCutsOptimum() {
+  printf("Running TestPhaserBandCutsOptimum:\n");
+  char M1[14] = {'T', 'T', 'T', 'T', 'T', 'T', 'A', 'A', 'A', 'A', 'A', 'A', 'A', 'A'};
+  char M2[14] = {'C', 'C', 'C', 'C', 'C', 'C', 'C', 'C', 'C', 'C', 'C', 'C', 'C', 'C'};
+  size_t M_len = 14;
+
+  char F1[8] = {'G', 'G', 'G', 'G', 'G', 'G', 'G', 'G'};
+  char F2[8] = {'T', 'T', 'T', 'T', 'T', 'T', 'T', 'T'};
+  size_t F_len = 8;
+
+  char C1[8] = {'A', 'A', 'A', 'A', 'A', 'A', 'A', 'A'};
+  char C2[8] = {'G', 'G', 'G', 'G', 'G', 'G', 'G', 'G'};
+  char phase_real[8] = {'0', '0', '0', '0', '0', '0', '0', '0'};
+  size_t C_len = 8;
+  // 16 matches and 6 deletions.
+  score_t expected = 2*((int)C_len)*SCORE_MATCH + 6*SCORE_GAP;
+  for (bool phase : {false, true}) {
+    Phaser * tmp =  new Phaser(M1, M2, M_len,
+                               F1, F2, F_len,
+                               C1, C2, C_len);
+    tmp->SetScoreGap(SCORE_GAP);
+    tmp->SetScoreMismatch(SCORE_MISMATCH);
+    tmp->SetScoreMatch(SCORE_MATCH);
+    tmp->SetBand(1);
+    score_t score = phase ? tmp->similarity_and_phase() : tmp->similarity();
+    if (score != expected) {
+      Fail();
+      return;
+    }
+    if (phase && !equalPhases(phase_real, tmp->GetPhaseString(), C_len)) {
+      Fail();
+      return;
+    }
+    delete(tmp);
+  }
+  Success();
+}
+
+void TestPhaserWavefront() {
+  printf("Running TestPhaserWavefront:\n");
+  size_t max_len = 80;
+  size_t n_repeats = 200;
+  for (size_t r = 0; r < n_repeats; r++) {
+    Trio trio;
+    if (r % 2) {
+      RandomTrio(max_len, &trio);
+    } else {
+      CloseTrio(1 + (size_t)rand() % max_len, &trio);
+    }
+    if (r % 10 == 0) {
+      // mid_k is 0: the checkpoints would be the cells of the plane 0. The
+      // small solver would take this sub-cube otherwise.
+      trio.C_len = 1;
+    }
+    bool ok = true;
+    for (bool phase : {false, true}) {
+      Phaser * full = NewPhaser(&trio);
+      Phaser * wavefront = NewPhaser(&trio);
+      wavefront->SetWavefront(true);
+      if (trio.C_len == 1) {
+        full->SetSmallPlanes(0);
+        wavefront->SetSmallPlanes(0);
+      }
+      ok = ok && SamePhasing(full, wavefront, &trio, phase);
+      delete(full);
+      delete(wavefront);
+    }
+    DeleteTrio(&trio);
+    if (!ok) {
+      Fail();
+      return;
+    }
+  }
+  Success();
+}
+
+// Close haplotypes with a single mismatch, the case the wavefront is for.
+void TestPhaserWavefrontMismatch() {
+  printf("Running TestPhaserWavefrontMismatch:\n");
+  char M1[8] = {'A', 'C', 'G', 'T', 'A', 'C', 'G', 'T'};
+  char M2[8] = {'C', 'A', 'T', 'G', 'C', 'A', 'T', 'G'};
+  size_t M_len = 8;
+
+  char F1[8] = {'G', 'T', 'A', 'C', 'G', 'T', 'A', 'C'};
+  char F2[8] = {'T', 'G', 'C', 'A', 'T', 'G', 'C', 'A'};
+  size_t F_len = 8;
+
+  char C1[8] = {'A', 'C', 'G', 'N', 'A', 'C', 'G', 'T'};
+  char C2[8] = {'G', 'T', 'A', 'C', 'G', 'T', 'A', 'C'};
+  char phase_real[8] = {'0', '0', '0', '0', '0', '0', '0', '0'};
+  size_t C_len = 8;
+  // 15 matches and 1 mismatch. At C[3] the other phase has 2 mismatches.
+  score_t expected = (2*(int)C_len - 1)*SCORE_MATCH + SCORE_MISMATCH;
+  for (bool phase : {false, true}) {
+    Phaser * tmp =  new Phaser(M1, M2, M_len,
+                               F1, F2, F_len,
+                               C1, C2, C_len);
+    tmp->SetScoreGap(SCORE_GAP);
+    tmp->SetScoreMismatch(SCORE_MISMATCH);
+    tmp->SetScoreMatch(SCORE_MATCH);
+    tmp->SetWavefront(true);
+    score_t score = phase ? tmp->similarity_and_phase() : tmp->similarity();
+    if (score != expected) {
+      Fail();
+      return;
+    }
+    if (phase && !equalPhases(phase_real, tmp->GetPhaseString(), C_len)) {
+      Fail();
+      return;
+    }
+    delete(tmp);
+  }
+  Success();
+}
+
+void TestPhaserProjectionBounds() {
+  printf("Running TestPhaserProjectionBounds:\n");
+  size_t max_len = 80;
+  size_t n_repeats = 200;
+  for (size_t r = 0; r < n_repeats; r++) {
+    Trio trio;
+    if (r % 2) {
+      RandomTrio(max_len, &trio);
+    } else {
+      CloseTrio(1 + (size_t)rand() % max_len, &trio);
+    }
+    if (r % 10 == 0) {
+      // mid_k is 0: the checkpoints would be the cells of the plane 0. The
+      // small solver would take this sub-cube otherwise.
+      trio.C_len = 1;
+    }
+    bool ok = true;
+    for (bool phase : {false, true}) {
+      Phaser * full = NewPhaser(&trio);
+      Phaser * pruned = NewPhaser(&trio);
+      pruned->SetProjectionBounds(true);
+      if (trio.C_len == 1) {
+        full->SetSmallPlanes(0);
+        pruned->SetSmallPlanes(0);
+      }
+      ok = ok && SamePhasing(full, pruned, &trio, phase);
+      delete(full);
+      delete(pruned);
+    }
+    DeleteTrio(&trio);
+    if (!ok) {
+      Fail();
+      return;
+    }
+  }
+  Success();
+}
+
+// C1 has a symbol that M lacks: the bound of C against M must allow for
+// its gap.
+void TestPhaserProjectionInsertion() {
+  printf("Running TestPhaserProjectionInsertion:\n");
+  char M1[3] = {'A', 'A', 'A'};
+  char M2[3] = {'C', 'C', 'C'};
+  size_t M_len = 3;
+
+  char F1[4] = {'G', 'G', 'G', 'G'};
+  char F2[4] = {'T', 'T', 'T', 'T'};
+  size_t F_len = 4;
+
+  char C1[4] = {'A', 'A', 'N', 'A'};
+  char C2[4] = {'G', 'G', 'G', 'G'};
+  char phase_real[4] = {'0', '0', '0', '0'};
+  size_t C_len = 4;
+  // 7 matches and the N of C1 against a gap.
+  score_t expected = (2*(int)C_len - 1)*SCORE_MATCH + SCORE_GAP;
+  for (bool phase : {false, true}) {
+    Phaser * tmp =  new Phaser(M1, M2, M_len,
+                               F1, F2, F_len,
+                               C1, C2, C_len);
+    tmp->SetScoreGap(SCORE_GAP);
+    tmp->SetScoreMismatch(SCORE_MISMATCH);
+    tmp->SetScoreMatch(SCORE_MATCH);
+    tmp->SetProjectionBounds(true);
+    score_t score = phase ? tmp->similarity_and_phase() : tmp->similarity();
+    if (score != expected) {
+      Fail();
+      return;
+    }
+    if (phase && !equalPhases(phase_real, tmp->GetPhaseString(), C_len)) {
+      Fail();
+      return;
+    }
+    delete(tmp);
+  }
+  Success();
+}
+
+void TestPhaserSharedVsGeneral() {
+  printf("Running TestPhaserSharedVsGeneral:\n");
+  size_t max_len = 30;
+  size_t n_repeats = 100;
+  for (size_t r = 0; r < n_repeats; r++) {
+    Trio trio;
+    RandomTrio(max_len, &trio);
+    Phaser * general = NewPhaser(&trio);
+    Phaser * shared = NewPhaser(&trio);
+    general->SetAVX2(false);
+    general->SetSharedReductions(false);
+    shared->SetAVX2(false);
+    shared->SetSharedReductions(true);
+    bool ok = SamePhasing(general, shared, &trio, true);
+    delete(general);
+    delete(shared);
+    DeleteTrio(&trio);
+    if (!ok) {
+      Fail();
+      return;
+    }
+  }
+  Success();
+}
+
+// Both parents switch haplotype at every column, so the best predecessor
+// of each state group changes from cell to cell.
+void TestPhaserSharedSwitches() {
+  printf("Running TestPhaserSharedSwitches:\n");
+  char M1[4] = {'A', 'A', 'A', 'A'};
+  char M2[4] = {'C', 'C', 'C', 'C'};
+  size_t M_len = 4;
+
+  char F1[4] = {'G', 'G', 'G', 'G'};
+  char F2[4] = {'T', 'T', 'T', 'T'};
+  size_t F_len = 4;
+
+  char C1[4] = {'A', 'C', 'A', 'C'};
+  char C2[4] = {'T', 'G', 'T', 'G'};
+  char phase_real[4] = {'0', '0', '0', '0'};
+  size_t C_len = 4;
+  // Every symbol matches.
+  for (bool shared : {false, true}) {
+    Phaser * tmp =  new Phaser(M1, M2, M_len,
+                               F1, F2, F_len,
+                               C1, C2, C_len);
+    tmp->SetScoreGap(SCORE_GAP);
+    tmp->SetScoreMismatch(SCORE_MISMATCH);
+    tmp->SetScoreMatch(SCORE_MATCH);
+    tmp->SetAVX2(false);
+    tmp->SetSharedReductions(shared);
+    score_t score = tmp->similarity_and_phase();
+    char * phase_algor = tmp->GetPhaseString();
+    if (score != 2*((int)C_len)*SCORE_MATCH) {
+      Fail();
+      return;
+    }
+    if (!equalPhases(phase_real, phase_algor, C_len)) {
+      Fail();
+      return;
+    }
+    delete(tmp);
+  }
+  Success();
+}
+
+// The traceback engine follows a path of the score of the checkpoint
+// recursion, the same one with every kernel. Ties between paths may be
+// broken otherwise than in the recursion, whose sub-cubes start afresh from
+// every state.
+void TestPhaserTraceback() {
+  printf("Running TestPhaserTraceback:\n");
+  size_t max_len = 30;
+  size_t n_repeats = 100;
+  for (size_t r = 0; r < n_repeats; r++) {
+    Trio trio;
+    RandomTrio(max_len, &trio);
+    Phaser * checkpoints = NewPhaser(&trio);
+    score_t expected = checkpoints->similarity_and_phase();
+    Phaser * scalar = NewPhaser(&trio);
+    Phaser * simd = NewPhaser(&trio);
+    scalar->SetAVX2(false);
+    scalar->SetTraceback(TRACEBACK_FULL);
+    simd->SetTraceback(TRACEBACK_FULL);
+    bool ok = SamePhasing(scalar, simd, &trio, true);
+    ok = ok && scalar->similarity() == expected;
+    delete(scalar);
+    delete(simd);
+    for (bool avx2 : {false, true}) {
+      Phaser * hybrid = NewPhaser(&trio);
+      hybrid->SetAVX2(avx2);
+      // Only the sub-cubes of a few planes fit, the larger ones recurse.
+      hybrid->SetMemoryBudget(8 * (max_len + 1) * (max_len + 1) * 8);
+      ok = ok && hybrid->similarity_and_phase() == expected;
+      delete(hybrid);
+    }
+    delete(checkpoints);
+    DeleteTrio(&trio);
+    if (!ok) {
+      Fail();
+      return;
+    }
+  }
+  Success();
+}
+
+// A phase switch and a deletion in M: every traceback engine finds them.
+void TestPhaserTracebackSwitch() {
+  printf("Running TestPhaserTracebackSwitch:\n");
+  char M1[5] = {'A', 'A', 'A', 'A', 'A'};
+  char M2[5] = {'C', 'C', 'C', 'C', 'C'};
+  size_t M_len = 5;
+
+  char F1[4] = {'G', 'G', 'G', 'G'};
+  char F2[4] = {'T', 'T', 'T', 'T'};
+  size_t F_len = 4;
+
+  char C1[4] = {'A', 'A', 'T', 'T'};
+  char C2[4] = {'G', 'G', 'A', 'A'};
+  char phase_real[4] = {'0', '0', '1', '1'};
+  size_t C_len = 4;
+  // 8 matches and the deletion of one symbol of M.
+  score_t expected = 2*((int)C_len)*SCORE_MATCH + SCORE_GAP;
+  // With the last budget, only the sub-cubes of a few planes fit and the
+  // larger ones recurse.
+  traceback_t engines[3] = {TRACEBACK_CHECKPOINTS, TRACEBACK_FULL, TRACEBACK_AUTO};
+  size_t budgets[3] = {0, 0, 8 * (M_len + 1) * (F_len + 1) * 6};
+  for (size_t e = 0; e < 3; e++) {
+    Phaser * tmp =  new Phaser(M1, M2, M_len,
+                               F1, F2, F_len,
+                               C1, C2, C_len);
+    tmp->SetScoreGap(SCORE_GAP);
+    tmp->SetScoreMismatch(SCORE_MISMATCH);
+    tmp->SetScoreMatch(SCORE_MATCH);
+    tmp->SetTraceback(engines[e]);
+    tmp->SetMemoryBudget(budgets[e]);
+    score_t score = tmp->similarity_and_phase();
+    char * phase_algor = tmp->GetPhaseString();
+    if (score != expected) {
+      Fail();
+      return;
+    }
+    if (!equalPhases(phase_real, phase_algor, C_len)) {
+      Fail();
+      return;
+    }
+    delete(tmp);
+  }
+  Success();
+}
+
+void TestPhaserSmallProblem() {
+  printf("Running TestPhaserSmallProblem:\n");
+  size_t n_repeats = 100;
+  for (size_t r = 0; r < n_repeats; r++) {
+    Trio trio;
+    RandomTrio(30, &trio);
+    Phaser * recursion = NewPhaser(&trio);
+    Phaser * leaves = NewPhaser(&trio);
+    Phaser * tail = NewPhaser(&trio);
+    recursion->SetSmallPlanes(0);
+    tail->SetSmallPlanes(8);
+    // The leaves of the recursion give the same phasing.
+    bool ok = SamePhasing(recursion, leaves, &trio, true);
+    ok = ok && tail->similarity_and_phase() == leaves->similarity();
+    delete(recursion);
+    delete(leaves);
+    delete(tail);
+    DeleteTrio(&trio);
+
+    // Whole problems that fit, same as TRACEBACK_FULL.
+    RandomTrio(12, &trio);
+    for (bool avx2 : {false, true}) {
+      Phaser * full = NewPhaser(&trio);
+      Phaser * small = NewPhaser(&trio);
+      full->SetAVX2(avx2);
+      small->SetAVX2(avx2);
+      full->SetTraceback(TRACEBACK_FULL);
+      small->SetSmallPlanes(trio.C_len);
+      ok = ok && SamePhasing(full, small, &trio, true);
+      delete(full);
+      delete(small);
+    }
+    DeleteTrio(&trio);
+    if (!ok) {
+      Fail();
+      return;
+    }
+  }
+  Success();
+}
+
+// A gap in C1, solved by the recursion, by its leaves and as a whole.
+void TestPhaserSmallChildGap() {
+  printf("Running TestPhaserSmallChildGap:\n");
+  char M1[3] = {'A', 'A', 'A'};
+  char M2[3] = {'C', 'C', 'C'};
+  size_t M_len = 3;
+
+  char F1[3] = {'G', 'G', 'G'};
+  char F2[3] = {'T', 'T', 'T'};
+  size_t F_len = 3;
+
+  char C1[3] = {'A', '-', 'A'};
+  char C2[3] = {'G', 'G', 'G'};
+  char phase_real[3] = {'0', '0', '0'};
+  size_t C_len = 3;
+  // 5 matches and the gap of C1 against M1[1].
+  score_t expected = (2*(int)C_len - 1)*SCORE_MATCH + SCORE_GAP;
+  for (size_t planes : {(size_t)0, (size_t)1, C_len}) {
+    Phaser * tmp =  new Phaser(M1, M2, M_len,
+                               F1, F2, F_len,
+                               C1, C2, C_len);
+    tmp->SetScoreGap(SCORE_GAP);
+    tmp->SetScoreMismatch(SCORE_MISMATCH);
+    tmp->SetScoreMatch(SCORE_MATCH);
+    tmp->SetSmallPlanes(planes);
+    score_t score = tmp->similarity_and_phase();
+    char * phase_algor = tmp->GetPhaseString();
+    if (score != expected) {
+      Fail();
+      return;
+    }
+    if (!equalPhases(phase_real, phase_algor, C_len)) {
+      Fail();
+      return;
+    }
+    delete(tmp);
+  }
+  Success();
+}
+
+// Gaps in both haplotypes of a parent over [p, p+len), as a long insertion
+// in another member leaves them.
+void GapRun(char * P1, char * P2, size_t P_len, size_t p, size_t len);
+void GapRun(char * P1, char * P2, size_t P_len, size_t p, size_t len) {
+  for (size_t x = p; x < P_len && x < p + len; x++) {
+    P1[x] = '-';
+    P2[x] = '-';
+  }
+}
+
+void TestPhaserGapRuns() {
+  printf("Running TestPhaserGapRuns:\n");
+  size_t n_repeats = 100;
+  for (size_t r = 0; r < n_repeats; r++) {
+    Trio trio;
+    RandomTrio(30, &trio);
+    for (size_t n = 0; n < 2; n++) {
+      GapRun(trio.M1, trio.M2, trio.M_len, (size_t)rand() % trio.M_len, 1 + (size_t)rand() % 8);
+      GapRun(trio.F1, trio.F2, trio.F_len, (size_t)rand() % trio.F_len, 1 + (size_t)rand() % 8);
+    }
+    bool ok = true;
+    for (traceback_t engine : {TRACEBACK_CHECKPOINTS, TRACEBACK_FULL}) {
+      for (bool avx2 : {false, true}) {
+        Phaser * plain = NewPhaser(&trio);
+        Phaser * runs = NewPhaser(&trio);
+        plain->SetGapRuns(false);
+        plain->SetAVX2(avx2);
+        runs->SetAVX2(avx2);
+        plain->SetTraceback(engine);
+        runs->SetTraceback(engine);
+        ok = ok && SamePhasing(plain, runs, &trio, true);
+        ok = ok && runs->OriginalM(0) == 0 && runs->OriginalF(0) == 0;
+        delete(plain);
+        delete(runs);
+      }
+    }
+    DeleteTrio(&trio);
+    if (!ok) {
+      Fail();
+      return;
+    }
+  }
+  Success();
+}
+
+// A run of 3 gap columns in both haplotypes of M, copied at no score.
+void TestPhaserGapRunMother() {
+  printf("Running TestPhaserGapRunMother:\n");
+  char M1[6] = {'A', '-', '-', '-', 'A', 'A'};
+  char M2[6] = {'C', '-', '-', '-', 'C', 'C'};
+  size_t M_len = 6;
+
+  char F1[3] = {'G', 'G', 'G'};
+  char F2[3] = {'T', 'T', 'T'};
+  size_t F_len = 3;
+
+  char C1[3] = {'A', 'A', 'A'};
+  char C2[3] = {'G', 'G', 'G'};
+  char phase_real[3] = {'0', '0', '0'};
+  size_t C_len = 3;
+  // Every symbol matches.
+  for (bool runs : {false, true}) {
+    Phaser * tmp =  new Phaser(M1, M2, M_len,
+                               F1, F2, F_len,
+                               C1, C2, C_len);
+    tmp->SetScoreGap(SCORE_GAP);
+    tmp->SetScoreMismatch(SCORE_MISMATCH);
+    tmp->SetScoreMatch(SCORE_MATCH);
+    tmp->SetGapRuns(runs);
+    score_t score = tmp->similarity_and_phase();
+    char * phase_algor = tmp->GetPhaseString();
+    if (score != 2*((int)C_len)*SCORE_MATCH) {
+      Fail();
+      return;
+    }
+    if (!equalPhases(phase_real, phase_algor, C_len)) {
+      Fail();
+      return;
+    }
+    delete(tmp);
+  }
+  Success();
+}
+
+// Both haplotypes of the member have a gap at p, and it is not gapped in
+// every column.
+bool Dropped(const char * P1, const char * P2, size_t P_len, size_t p);
+bool Dropped(const char * P1, const char * P2, size_t P_len, size_t p) {
+  bool all_gaps = true;
+  for (size_t x = 0; x < P_len; x++) {
+    all_gaps = all_gaps && P1[x] == '-' && P2[x] == '-';
+  }
+  return !all_gaps && P1[p] == '-' && P2[p] == '-';
+}
+
+// Drops the columns where both haplotypes of a member have a gap, and checks
+// the columns kept.
+bool CompactMember(char ** P1, char ** P2, size_t * P_len, std::vector<size_t> * columns);
+bool CompactMember(char ** P1, char ** P2, size_t * P_len, std::vector<size_t> * columns) {
+  char * original_1 = Utils::CopySeq(*P1, *P_len);
+  char * original_2 = Utils::CopySeq(*P2, *P_len);
+  size_t original_len = *P_len;
+  Utils::Compact(P1, P2, P_len, columns);
+  bool ok = (columns->size() == *P_len) && *P_len > 0;
+  size_t pos = 0;
+  for (size_t p = 0; p < original_len; p++) {
+    if (Dropped(original_1, original_2, original_len, p)) {
+      continue;
+    }
+    ok = ok && pos < *P_len && (*columns)[pos] == p;
+    ok = ok && (*P1)[pos] == original_1[p] && (*P2)[pos] == original_2[p];
+    pos++;
+  }
+  ok = ok && pos == *P_len;
+  delete[] original_1;
+  delete[] original_2;
+  return ok;
+}
+
+// The compacted trio scores the same, and its phase string expands to '?'
+// at the gap columns of C. In some trios a member is gapped in every
+// column, as next to an insertion in another member, and is kept whole.
+void TestCompactTrio() {
+  printf("Running TestCompactTrio:\n");
+  size_t n_repeats = 100;
+  for (size_t r = 0; r < n_repeats; r++) {
+    Trio trio;
+    RandomTrio(30, &trio);
+    for (size_t n = 0; n < 2; n++) {
+      GapRun(trio.M1, trio.M2, trio.M_len, (size_t)rand() % trio.M_len, 1 + (size_t)rand() % 3);
+      GapRun(trio.F1, trio.F2, trio.F_len, (size_t)rand() % trio.F_len, 1 + (size_t)rand() % 3);
+      GapRun(trio.C1, trio.C2, trio.C_len, (size_t)rand() % trio.C_len, 1 + (size_t)rand() % 3);
+    }
+    switch (r % 10) {
+      case 0:
+        GapRun(trio.M1, trio.M2, trio.M_len, 0, trio.M_len);
+        break;
+      case 1:
+        GapRun(trio.F1, trio.F2, trio.F_len, 0, trio.F_len);
+        break;
+      case 2:
+        GapRun(trio.C1, trio.C2, trio.C_len, 0, trio.C_len);
+        break;
+      default:
+        break;
+    }
+    size_t original_len = trio.C_len;
+    char * original_1 = Utils::CopySeq(trio.C1, trio.C_len);
+    char * original_2 = Utils::CopySeq(trio.C2, trio.C_len);
+    Phaser * plain = NewPhaser(&trio);
+    score_t expected = plain->similarity();
+    delete(plain);
+    std::vector<size_t> m_columns;
+    std::vector<size_t> f_columns;
+    std::vector<size_t> c_columns;
+    bool ok = CompactMember(&trio.M1, &trio.M2, &trio.M_len, &m_columns);
+    ok = ok && CompactMember(&trio.F1, &trio.F2, &trio.F_len, &f_columns);
+    ok = ok && CompactMember(&trio.C1, &trio.C2, &trio.C_len, &c_columns);
+    if (ok) {
+      Phaser * compact = NewPhaser(&trio);
+      ok = (compact->similarity_and_phase() == expected);
+      char * phase = Utils::Expand(compact->GetPhaseString(), c_columns, original_len);
+      for (size_t k = 0; k < original_len; k++) {
+        bool dropped = Dropped(original_1, original_2, original_len, k);
+        ok = ok && (phase[k] == '?') == dropped;
+      }
+      delete[] phase;
+      delete(compact);
+    }
+    delete[] original_1;
+    delete[] original_2;
+    DeleteTrio(&trio);
+    if (!ok) {
+      Fail();
+      return;
+    }
+  }
+  Success();
+}
+
+// Column 1 is an insertion in some other sequence: every member has a gap
+// there. Compacted, the trio scores the same and the phase of C gets a '?'
+// at column 1.
+void TestCompactInsertion() {
+  printf("Running TestCompactInsertion:\n");
+  char M1[3] = {'A', '-', 'A'};
+  char M2[3] = {'C', '-', 'C'};
+  char F1[3] = {'G', '-', 'G'};
+  char F2[3] = {'T', '-', 'T'};
+  char C1[3] = {'A', '-', 'A'};
+  char C2[3] = {'G', '-', 'G'};
+  char phase_real[3] = {'0', '?', '0'};
+  size_t original_len = 3;
+  // Every symbol matches.
+  Trio trio = {Utils::CopySeq(M1, original_len), Utils::CopySeq(M2, original_len), original_len,
+               Utils::CopySeq(F1, original_len), Utils::CopySeq(F2, original_len), original_len,
+               Utils::CopySeq(C1, original_len), Utils::CopySeq(C2, original_len), original_len};
+  std::vector<size_t> m_columns;
+  std::vector<size_t> f_columns;
+  std::vector<size_t> c_columns;
+  Utils::Compact(&trio.M1, &trio.M2, &trio.M_len, &m_columns);
+  Utils::Compact(&trio.F1, &trio.F2, &trio.F_len, &f_columns);
+  Utils::Compact(&trio.C1, &trio.C2, &trio.C_len, &c_columns);
+  bool ok = (trio.M_len == 2 && trio.F_len == 2 && trio.C_len == 2);
+  ok = ok && c_columns[0] == 0 && c_columns[1] == 2;
+  if (ok) {
+    Phaser * compact = NewPhaser(&trio);
+    ok = (compact->similarity_and_phase() == 4*SCORE_MATCH);
+    char * phase = Utils::Expand(compact->GetPhaseString(), c_columns, original_len);
+    ok = ok && equalPhases(phase_real, phase, original_len);
+    delete[] phase;
+    delete(compact);
+  }
+  DeleteTrio(&trio);
+  if (!ok) {
+    Fail();
+    return;
+  }
+  Success();
+}
+
+// Copies most columns of P1 into P2, as in the homozygous stretches of a
+// real trio.
+void MostlyHomozygous(char * P1, char * P2, size_t P_len);
+void MostlyHomozygous(char * P1, char * P2, size_t P_len) {
+  for (size_t x = 0; x < P_len; x++) {
+    if (rand() % 5 != 0) {
+      P2[x] = P1[x];
+    }
+  }
+}
+
+void TestPhaserHomozygousCollapse() {
+  printf("Running TestPhaserHomozygousCollapse:\n");
+  size_t n_repeats = 100;
+  for (size_t r = 0; r < n_repeats; r++) {
+    Trio trio;
+    RandomTrio(30, &trio);
+    MostlyHomozygous(trio.M1, trio.M2, trio.M_len);
+    MostlyHomozygous(trio.F1, trio.F2, trio.F_len);
+    MostlyHomozygous(trio.C1, trio.C2, trio.C_len);
+    bool ok = true;
+    for (traceback_t engine : {TRACEBACK_CHECKPOINTS, TRACEBACK_FULL}) {
+      for (score_width_t width : {WIDTH_16, WIDTH_32}) {
+        Phaser * full = NewPhaser(&trio);
+        Phaser * collapsed = NewPhaser(&trio);
+        full->SetAVX2(false);
+        collapsed->SetAVX2(false);
+        full->SetCollapseHomozygous(false);
+        full->SetTraceback(engine);
+        collapsed->SetTraceback(engine);
+        full->SetScoreWidth(width);
+        collapsed->SetScoreWidth(width);
+        ok = ok && SamePhasing(full, collapsed, &trio, true);
+        delete(full);
+        delete(collapsed);
+      }
+    }
+    DeleteTrio(&trio);
+    if (!ok) {
+      Fail();
+      return;
+    }
+  }
+  Success();
+}
+
+// Each member is homozygous but at its last column.
+void TestPhaserHomozygousStretch() {
+  printf("Running TestPhaserHomozygousStretch:\n");
+  char M1[4] = {'A', 'A', 'A', 'A'};
+  char M2[4] = {'A', 'A', 'A', 'C'};
+  size_t M_len = 4;
+
+  char F1[4] = {'G', 'G', 'G', 'G'};
+  char F2[4] = {'G', 'G', 'G', 'T'};
+  size_t F_len = 4;
+
+  char C1[4] = {'A', 'A', 'A', 'C'};
+  char C2[4] = {'G', 'G', 'G', 'T'};
+  char phase_real[4] = {'0', '0', '0', '0'};
+  size_t C_len = 4;
+  // Every symbol matches.
+  for (bool collapse : {false, true}) {
+    Phaser * tmp =  new Phaser(M1, M2, M_len,
+                               F1, F2, F_len,
+                               C1, C2, C_len);
+    tmp->SetScoreGap(SCORE_GAP);
+    tmp->SetScoreMismatch(SCORE_MISMATCH);
+    tmp->SetScoreMatch(SCORE_MATCH);
+    tmp->SetCollapseHomozygous(collapse);
+    score_t score = tmp->similarity_and_phase();
+    char * phase_algor = tmp->GetPhaseString();
+    if (score != 2*((int)C_len)*SCORE_MATCH) {
+      Fail();
+      return;
+    }
+    if (!equalPhases(phase_real, phase_algor, C_len)) {
+      Fail();
+      return;
+    }
+    delete(tmp);
+  }
+  Success();
+}
+
+// Every phase of phase, negated if flip, is one that consensus allows.
+bool InConsensus(const char * consensus, const char * phase, bool flip, size_t len);
+bool InConsensus(const char * consensus, const char * phase, bool flip, size_t len) {
+  for (size_t k = 0; k < len; k++) {
+    char expected = consensus[k];
+    if (flip && expected != '?') {
+      expected = (expected == '0') ? '1' : '0';
+    }
+    if (expected != '?' && expected != phase[k]) {
+      printf("Phase %c at %zu, consensus %c\n", phase[k], k, consensus[k]);
+      return false;
+    }
+  }
+  return true;
+}
+
+// The runs of MultiPassPhaser, with the parents and the child haplotypes
+// swapped, and each traceback engine, all pick co-optimal paths: their
+// phases are the ones of the consensus, except at its '?'.
+void TestPhaserConsensus() {
+  printf("Running TestPhaserConsensus:\n");
+  size_t n_repeats = 100;
+  for (size_t r = 0; r < n_repeats; r++) {
+    Trio trio;
+    RandomTrio(20, &trio);
+    Phaser * consensus = NewPhaser(&trio);
+    Phaser * scalar = NewPhaser(&trio);
+    Phaser * plain = NewPhaser(&trio);
+    scalar->SetAVX2(false);
+    score_t expected = plain->similarity();
+    bool ok = (consensus->similarity_and_consensus() == expected);
+    ok = ok && (scalar->similarity_and_consensus() == expected);
+    ok = ok && equalPhases(consensus->GetPhaseString(), scalar->GetPhaseString(), trio.C_len);
+    for (traceback_t engine : {TRACEBACK_CHECKPOINTS, TRACEBACK_FULL}) {
+      for (bool swap_parents : {false, true}) {
+        for (bool swap_child : {false, true}) {
+          Phaser * phaser = new Phaser(swap_parents ? trio.F1 : trio.M1,
+                                       swap_parents ? trio.F2 : trio.M2,
+                                       swap_parents ? trio.F_len : trio.M_len,
+                                       swap_parents ? trio.M1 : trio.F1,
+                                       swap_parents ? trio.M2 : trio.F2,
+                                       swap_parents ? trio.M_len : trio.F_len,
+                                       swap_child ? trio.C2 : trio.C1,
+                                       swap_child ? trio.C1 : trio.C2,
+                                       trio.C_len);
+          phaser->SetScoreGap(SCORE_GAP);
+          phaser->SetScoreMismatch(SCORE_MISMATCH);
+          phaser->SetScoreMatch(SCORE_MATCH);
+          phaser->SetTraceback(engine);
+          ok = ok && (phaser->similarity_and_phase() == expected);
+          ok = ok && InConsensus(consensus->GetPhaseString(), phaser->GetPhaseString(),
+                                 swap_parents != swap_child, trio.C_len);
+          delete(phaser);
+        }
+      }
+    }
+    delete(consensus);
+    delete(scalar);
+    delete(plain);
+    DeleteTrio(&trio);
+    if (!ok) {
+      Fail();
+      return;
+    }
+  }
+  Success();
+}
+
+// C[1] is N|N and both parents have N at column 1: phasing it either way
+// scores the same, and only that column is a '?'.
+void TestPhaserConsensusTie() {
+  printf("Running TestPhaserConsensusTie:\n");
+  char M1[3] = {'A', 'N', 'A'};
+  char M2[3] = {'C', 'N', 'C'};
+  size_t M_len = 3;
+
+  char F1[3] = {'G', 'N', 'G'};
+  char F2[3] = {'T', 'N', 'T'};
+  size_t F_len = 3;
+
+  char C1[3] = {'A', 'N', 'A'};
+  char C2[3] = {'G', 'N', 'G'};
+  char phase_real[3] = {'0', '?', '0'};
+  size_t C_len = 3;
+  // Every symbol matches.
+  for (bool avx2 : {false, true}) {
+    Phaser * tmp =  new Phaser(M1, M2, M_len,
+                               F1, F2, F_len,
+                               C1, C2, C_len);
+    tmp->SetScoreGap(SCORE_GAP);
+    tmp->SetScoreMismatch(SCORE_MISMATCH);
+    tmp->SetScoreMatch(SCORE_MATCH);
+    tmp->SetAVX2(avx2);
+    score_t score = tmp->similarity_and_consensus();
+    char * phase_algor = tmp->GetPhaseString();
+    if (score != 2*((int)C_len)*SCORE_MATCH) {
+      Fail();
+      return;
+    }
+    if (!equalPhases(phase_real, phase_algor, C_len)) {
+      Fail();
+      return;
+    }
+    delete(tmp);
+  }
+  Success();
+}
+
+// Swapping C1[k] and C2[k] maps each alignment to one of the same score
+// that phases C[k] the other way: the margins do not change, and only the
+// phase of C[k] flips. The margins are 0 just on the '?'.
+void TestPhaserMargins() {
+  printf("Running TestPhaserMargins:\n");
+  size_t n_repeats = 100;
+  for (size_t r = 0; r < n_repeats; r++) {
+    Trio trio;
+    RandomTrio(20, &trio);
+    Phaser * phaser = NewPhaser(&trio);
+    score_t expected = phaser->similarity_and_consensus();
+    const char * phase = phaser->GetPhaseString();
+    const score_t * margins = phaser->GetPhaseMargins();
+    bool ok = true;
+    for (size_t k = 0; k < trio.C_len; k++) {
+      ok = ok && (margins[k] >= 0) && ((margins[k] == 0) == (phase[k] == '?'));
+    }
+    size_t k_swap = (size_t)rand() % trio.C_len;
+    std::swap(trio.C1[k_swap], trio.C2[k_swap]);
+    Phaser * swapped = NewPhaser(&trio);
+    ok = ok && (swapped->similarity_and_consensus() == expected);
+    for (size_t k = 0; k < trio.C_len; k++) {
+      char flipped = phase[k];
+      if (k == k_swap && flipped != '?') {
+        flipped = (flipped == '0') ? '1' : '0';
+      }
+      ok = ok && (swapped->GetPhaseString()[k] == flipped);
+      ok = ok && (swapped->GetPhaseMargins()[k] == margins[k]);
+    }
+    delete(phaser);
+    delete(swapped);
+    DeleteTrio(&trio);
+    if (!ok) {
+      Fail();
+      return;
+    }
+  }
+  Success();
+}
+
+// The trio of TestPhaserConsensusTie. Phasing C[0] or C[2] the other way
+// turns its two matches into mismatches, cheaper than the 4 gaps of a
+// shift; C[1] loses nothing.
+void TestPhaserMarginsTie() {
+  printf("Running TestPhaserMarginsTie:\n");
+  char M1[3] = {'A', 'N', 'A'};
+  char M2[3] = {'C', 'N', 'C'};
+  size_t M_len = 3;
+
+  char F1[3] = {'G', 'N', 'G'};
+  char F2[3] = {'T', 'N', 'T'};
+  size_t F_len = 3;
+
+  char C1[3] = {'A', 'N', 'A'};
+  char C2[3] = {'G', 'N', 'G'};
+  size_t C_len = 3;
+  score_t flip = 2*SCORE_MATCH - 2*SCORE_MISMATCH;
+  score_t margins_real[3] = {flip, 0, flip};
+  Phaser * tmp =  new Phaser(M1, M2, M_len,
+                             F1, F2, F_len,
+                             C1, C2, C_len);
+  tmp->SetScoreGap(SCORE_GAP);
+  tmp->SetScoreMismatch(SCORE_MISMATCH);
+  tmp->SetScoreMatch(SCORE_MATCH);
+  score_t score = tmp->similarity_and_consensus();
+  const score_t * margins = tmp->GetPhaseMargins();
+  if (score != 2*((int)C_len)*SCORE_MATCH) {
+    Fail();
+    return;
+  }
+  for (size_t k = 0; k < C_len; k++) {
+    if (margins[k] != margins_real[k]) {
+      Fail();
+      return;
+    }
+  }
+  delete(tmp);
+  Success();
+}
+
+// Each lane of similarity_and_consensus_schemes is the scalar
+// similarity_and_consensus under its scheme. 11 schemes take two sweeps,
+// the second one with lanes left over.
+void TestPhaserSchemes() {
+  printf("Running TestPhaserSchemes:\n");
+  size_t n_repeats = 20;
+  const size_t n_schemes = 11;
+  for (size_t r = 0; r < n_repeats; r++) {
+    Trio trio;
+    RandomTrio(20, &trio);
+    ScoringScheme schemes[n_schemes];
+    score_t scores[n_schemes];
+    char * phases[n_schemes];
+    for (size_t s = 0; s < n_schemes; s++) {
+      schemes[s].gap = -1 - rand() % 4;
+      schemes[s].mismatch = -1 - rand() % 4;
+      schemes[s].match = 1 + rand() % 4;
+      phases[s] = new char[trio.C_len];
+    }
+    Phaser * lanes = NewPhaser(&trio);
+    lanes->similarity_and_consensus_schemes(schemes, n_schemes, scores, phases);
+    // Without budget for the lanes, the schemes run one by one, and the
+    // phaser keeps its own scores.
+    score_t single_scores[n_schemes];
+    char * single_phases[n_schemes];
+    for (size_t s = 0; s < n_schemes; s++) {
+      single_phases[s] = new char[trio.C_len];
+    }
+    Phaser * single = NewPhaser(&trio);
+    single->SetSchemeBudget(0);
+    single->similarity_and_consensus_schemes(schemes, n_schemes, single_scores, single_phases);
+    bool ok = (single->similarity() == lanes->similarity());
+    for (size_t s = 0; s < n_schemes; s++) {
+      ok = ok && (single_scores[s] == scores[s]);
+      ok = ok && equalPhases(single_phases[s], phases[s], trio.C_len);
+      delete[] single_phases[s];
+    }
+    delete(single);
+    for (size_t s = 0; s < n_schemes; s++) {
+      Phaser * phaser = NewPhaser(&trio);
+      phaser->SetScoreGap(schemes[s].gap);
+      phaser->SetScoreMismatch(schemes[s].mismatch);
+      phaser->SetScoreMatch(schemes[s].match);
+      ok = ok && (phaser->similarity_and_consensus() == scores[s]);
+      ok = ok && equalPhases(phaser->GetPhaseString(), phases[s], trio.C_len);
+      delete(phaser);
+      delete[] phases[s];
+    }
+    delete(lanes);
+    DeleteTrio(&trio);
+    if (!ok) {
+      Fail();
+      return;
+    }
+  }
+  Success();
+}
+
+// The trio of TestPhaserConsensusTie under two schemes: 6 matches each,
+// and the same '?' at C[1], with the lanes and one scheme at a time.
+void TestPhaserSchemesTie() {
+  printf("Running TestPhaserSchemesTie:\n");
+  char M1[3] = {'A', 'N', 'A'};
+  char M2[3] = {'C', 'N', 'C'};
+  size_t M_len = 3;
+
+  char F1[3] = {'G', 'N', 'G'};
+  char F2[3] = {'T', 'N', 'T'};
+  size_t F_len = 3;
+
+  char C1[3] = {'A', 'N', 'A'};
+  char C2[3] = {'G', 'N', 'G'};
+  char phase_real[3] = {'0', '?', '0'};
+  size_t C_len = 3;
+  const size_t n_schemes = 2;
+  ScoringScheme schemes[n_schemes] = {{-1, -1, 1}, {-2, -3, 2}};
+  score_t scores_real[n_schemes] = {6, 12};
+  for (size_t budget : {(size_t)0, SCHEME_BUDGET}) {
+    score_t scores[n_schemes];
+    char * phases[n_schemes];
+    for (size_t s = 0; s < n_schemes; s++) {
+      phases[s] = new char[C_len];
+    }
+    Phaser * tmp =  new Phaser(M1, M2, M_len,
+                               F1, F2, F_len,
+                               C1, C2, C_len);
+    tmp->SetSchemeBudget(budget);
+    tmp->similarity_and_consensus_schemes(schemes, n_schemes, scores, phases);
+    for (size_t s = 0; s < n_schemes; s++) {
+      if (scores[s] != scores_real[s]) {
+        Fail();
+        return;
+      }
+      if (!equalPhases(phase_real, phases[s], C_len)) {
+        Fail();
+        return;
+      }
+      delete[] phases[s];
+    }
+    delete(tmp);
+  }
+  Success();
+}
 
 int main() {
   // The following asseertions are not necessary in general,
@@ -2150,6 +3749,7 @@ int main() {
   if (special) {
   } else {
     TestFasta();
+    TestEncodedScores();
     
     TestPhaserShortK_A();
     TestPhaserShortK_B();
@@ -2211,6 +3811,41 @@ int main() {
       TestPhaserExhaustiveSameLength();
       TestPhaserExhaustiveVarLength();
     }
+
+    TestPhaserAVX2VsScalar();
+    TestPhaserAVX2Recomb();
+    TestPhaserDiagonalsVsRows();
+    TestPhaserDiagonalsDeletion();
+    TestPhaserNarrowScores();
+    TestPhaserNarrowSaturated();
+    TestPhaserDeltasVsRows();
+    TestPhaserDeltasMismatchIndel();
+    TestPhaserScoreOnly();
+    TestPhaserScoreOnlyRecomb();
+    TestPhaserBanded();
+    TestPhaserBandCutsOptimum();
+    TestPhaserWavefront();
+    TestPhaserWavefrontMismatch();
+    TestPhaserProjectionBounds();
+    TestPhaserProjectionInsertion();
+    TestPhaserSharedVsGeneral();
+    TestPhaserSharedSwitches();
+    TestPhaserTraceback();
+    TestPhaserTracebackSwitch();
+    TestPhaserSmallProblem();
+    TestPhaserSmallChildGap();
+    TestPhaserGapRuns();
+    TestPhaserGapRunMother();
+    TestCompactTrio();
+    TestCompactInsertion();
+    TestPhaserHomozygousCollapse();
+    TestPhaserHomozygousStretch();
+    TestPhaserConsensus();
+    TestPhaserConsensusTie();
+    TestPhaserMargins();
+    TestPhaserMarginsTie();
+    TestPhaserSchemes();
+    TestPhaserSchemesTie();
   }
   Summary();
 }
@@ -429,27 +429,38 @@ char Utils::RandomChar() {
 void Utils::Compact(char ** A,
                     char ** B,
                     size_t *len) {
-  size_t new_len = *len;
+  std::vector<size_t> columns;
+  Compact(A, B, len, &columns);
+}
+
+void Utils::Compact(char ** A,
+                    char ** B,
+                    size_t *len,
+                    std::vector<size_t> * columns) {
+  columns->clear();
   for (size_t i = 0; i < *len; i++) {
-    if ((*A)[i] == '-' && (*B)[i] == '-') {
-      new_len--;
+    if ((*A)[i] != '-' || (*B)[i] != '-') {
+      columns->push_back(i);
     }
   }
+  size_t new_len = columns->size();
+  if (new_len == 0) {
+    // A member gapped in every column is left as it is: a Phaser needs at
+    // least one column, and the gaps score as they did.
+    for (size_t i = 0; i < *len; i++) {
+      columns->push_back(i);
+    }
+    return;
+  }
   if (new_len == (*len))
     return;
 
   char * new_A = new char[new_len];
   char * new_B = new char[new_len];
-
-  size_t pos = 0;
-  for (size_t i = 0; i < *len; i++) {
-    if ((*A)[i] != '-' || (*B)[i] != '-') {
-      new_A[pos] = (*A)[i];
-      new_B[pos] = (*B)[i];
-      pos++;
-    }
+  for (size_t pos = 0; pos < new_len; pos++) {
+    new_A[pos] = (*A)[(*columns)[pos]];
+    new_B[pos] = (*B)[(*columns)[pos]];
   }
-  assert(pos == new_len);
   delete[] (*A);
   delete[] (*B);
   *A = new_A;
@@ -457,6 +468,20 @@ void Utils::Compact(char ** A,
   *len = new_len;
 }
 
+char * Utils::Expand(char * phase,
+                     const std::vector<size_t> & columns,
+                     size_t original_len) {
+  char * ans = new char[original_len];
+  for (size_t i = 0; i < original_len; i++) {
+    ans[i] = '?';
+  }
+  for (size_t pos = 0; pos < columns.size(); pos++) {
+    assert(columns[pos] < original_len);
+    ans[columns[pos]] = phase[pos];
+  }
+  return ans;
+}
+
 void Utils::CreateOffspring(char * M1, char * M2, size_t M_len,
                             char * F1, char * F2, size_t F_len,
                             double pm_ratio,
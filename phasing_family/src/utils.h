@@ -6,6 +6,7 @@
 #define SRC_UTILS_H_
 #include "./basic.h"
 #include "./debug.h"
+#include <vector>
 
 class Utils {
  public:
@@ -87,6 +88,17 @@ class Utils {
   static void Compact(char ** A,
                       char ** B,
                       size_t *len);
+  // As above, and columns gets the original position of each column kept.
+  // When every column is dropped, all of them are kept instead.
+  static void Compact(char ** A,
+                      char ** B,
+                      size_t *len,
+                      std::vector<size_t> * columns);
+  // The string of original_len symbols that has phase[p] at columns[p],
+  // and '?' at the columns that were dropped.
+  static char * Expand(char * phase,
+                       const std::vector<size_t> & columns,
+                       size_t original_len);
   static void Scramble(char *A , char *B, size_t len, size_t chunk_len);
   static char * MeioticShuffle(char *A , char *B, size_t len, size_t n_cuts);
   static size_t * GenerateCuts(size_t len, size_t n_cuts);